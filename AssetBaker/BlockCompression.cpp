@@ -0,0 +1,177 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+
+static uint16_t packRgb565(const float color[3])
+{
+	uint32_t r = static_cast<uint32_t>(std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+	uint32_t g = static_cast<uint32_t>(std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+	uint32_t b = static_cast<uint32_t>(std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRgb565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+void encodeBc1Block(const uint8_t texels[64], uint8_t block[8])
+{
+	// principal axis of the block colours: power iteration on the covariance matrix
+	float mean[3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++) mean[c] += texels[i * 4 + c] / 16.0f;
+	}
+
+	float covariance[3][3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { texels[i * 4] - mean[0], texels[i * 4 + 1] - mean[1], texels[i * 4 + 2] - mean[2] };
+		for (int a = 0; a < 3; a++)
+		{
+			for (int b = 0; b < 3; b++) covariance[a][b] += d[a] * d[b];
+		}
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[3];
+		for (int a = 0; a < 3; a++)
+		{
+			next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+		}
+		float length = std::max({ std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2]) });
+		if (length < 1e-6f) break;							// flat block, any axis works
+		for (int a = 0; a < 3; a++) axis[a] = next[a] / length;
+	}
+
+	// endpoints: the two texels furthest apart along the axis
+	int minTexel = 0, maxTexel = 0;
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = texels[i * 4] * axis[0] + texels[i * 4 + 1] * axis[1] + texels[i * 4 + 2] * axis[2];
+		if (projection < minProjection) { minProjection = projection; minTexel = i; }
+		if (projection > maxProjection) { maxProjection = projection; maxTexel = i; }
+	}
+
+	float maxColor[3] = { float(texels[maxTexel * 4]), float(texels[maxTexel * 4 + 1]), float(texels[maxTexel * 4 + 2]) };
+	float minColor[3] = { float(texels[minTexel * 4]), float(texels[minTexel * 4 + 1]), float(texels[minTexel * 4 + 2]) };
+	uint16_t color0 = packRgb565(maxColor);
+	uint16_t color1 = packRgb565(minColor);
+
+	// color0 > color1 selects the 4 colour mode, equal endpoints only need index 0
+	if (color0 < color1) std::swap(color0, color1);
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		unpackRgb565(color0, palette[0]);
+		unpackRgb565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestDistance = INT32_MAX;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = texels[i * 4] - palette[p][0];
+				int dg = texels[i * 4 + 1] - palette[p][1];
+				int db = texels[i * 4 + 2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance) { bestDistance = distance; best = p; }
+			}
+			indices |= static_cast<uint32_t>(best) << (i * 2);
+		}
+	}
+
+	block[0] = color0 & 0xFF;
+	block[1] = color0 >> 8;
+	block[2] = color1 & 0xFF;
+	block[3] = color1 >> 8;
+	for (int i = 0; i < 4; i++) block[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+void encodeBc3AlphaBlock(const uint8_t texels[64], uint8_t block[8])
+{
+	// alpha0 > alpha1 selects the 8 value mode: alpha0, alpha1 and 6 values between them
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = std::max<int>(alpha0, texels[i * 4 + 3]);
+		alpha1 = std::min<int>(alpha1, texels[i * 4 + 3]);
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		int palette[8] = { alpha0, alpha1 };
+		for (int p = 2; p < 8; p++) palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			for (int p = 1; p < 8; p++)
+			{
+				if (std::abs(texels[i * 4 + 3] - palette[p]) < std::abs(texels[i * 4 + 3] - palette[best])) best = p;
+			}
+			indices |= static_cast<uint64_t>(best) << (i * 3);
+		}
+	}
+
+	block[0] = static_cast<uint8_t>(alpha0);
+	block[1] = static_cast<uint8_t>(alpha1);
+	for (int i = 0; i < 6; i++) block[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// Calls encode for every 4x4 block in row order, edge texels are repeated into partial blocks
+template<typename Encode>
+static std::vector<char> compressBlocks(const uint8_t* rgba, uint32_t width, uint32_t height, size_t blockSize, Encode encode)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	std::vector<char> compressed(blocksX * blocksY * blockSize);
+
+	uint8_t texels[64];
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+				uint32_t y = std::min(by * 4 + i / 4, height - 1);
+				std::copy_n(rgba + (static_cast<size_t>(y) * width + x) * 4, 4, texels + i * 4);
+			}
+			encode(texels, reinterpret_cast<uint8_t*>(compressed.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize));
+		}
+	}
+	return compressed;
+}
+
+std::vector<char> compressBc1(const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	return compressBlocks(rgba, width, height, 8, [](const uint8_t* texels, uint8_t* block) { encodeBc1Block(texels, block); });
+}
+
+std::vector<char> compressBc3(const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	return compressBlocks(rgba, width, height, 16, [](const uint8_t* texels, uint8_t* block)
+	{
+		encodeBc3AlphaBlock(texels, block);
+		encodeBc1Block(texels, block + 8);
+	});
+}
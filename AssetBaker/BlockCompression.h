@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// BC1 / BC3 encoders for RGBA8 images, quality comparable to a fast runtime compressor:
+// endpoints are the texels furthest apart along the principal colour axis of each block, no refinement
+// Images that aren't a multiple of 4 repeat their last row / column into the partial blocks
+
+// 8 bytes per 4x4 block, colour only (4 colour mode, always opaque)
+std::vector<char> compressBc1(const uint8_t* rgba, uint32_t width, uint32_t height);
+// 16 bytes per 4x4 block, interpolated alpha followed by a BC1 colour block
+std::vector<char> compressBc3(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+void encodeBc1Block(const uint8_t texels[64], uint8_t block[8]);
+void encodeBc3AlphaBlock(const uint8_t texels[64], uint8_t block[8]);
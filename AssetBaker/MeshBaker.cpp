@@ -0,0 +1,125 @@
+#include "MeshBaker.h"
+#include "../AssetBlob.h"
+#include "../MeshOptimizer.h"
+
+#include <cstdio>
+#include <cstddef>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// Float layout of the renderer (Vertex in Utilities.h, inputs of Shaders/shader.vert), packed before writing
+struct BakedVertex
+{
+	float position[3];
+	float color[3];
+	float coordinates[2];
+};
+static_assert(sizeof(BakedVertex) == FLOAT_VERTEX_SIZE, "BakedVertex must match the float vertex layout");
+
+// "textures/wall.png" -> "wall.texblob", textures are looked up in Textures/ by file name only
+static std::string bakedTextureName(const std::string& sourcePath)
+{
+	std::string name = sourcePath.substr(sourcePath.find_last_of("/\\") + 1);
+	name = name.substr(0, name.find_last_of('.')) + TEXTURE_BLOB_EXTENSION;
+	if (name.size() >= ASSET_BLOB_NAME_SIZE)
+	{
+		throw std::runtime_error("Texture name " + name + " is too long for a mesh blob!");
+	}
+	return name;
+}
+
+void bakeMesh(const std::string& inputFile, const std::string& outputFile, VertexLayout layout)
+{
+	// identical vertices are welded so the reordering below has something to reuse
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(inputFile,
+		aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_PreTransformVertices |
+		aiProcess_SortByPType | aiProcess_FlipUVs);
+	if (scene == nullptr)
+	{
+		throw std::runtime_error("Failed to import " + inputFile + " (" + importer.GetErrorString() + ")");
+	}
+
+	VertexLayoutAttribute layoutAttributes[VERTEX_LAYOUT_ATTRIBUTE_COUNT];
+	std::vector<MeshBlobAttribute> attributes;
+	MeshBlobHeader header = {};
+	header.vertexStride = describeVertexLayout(layout, layoutAttributes);
+	header.attributeCount = VERTEX_LAYOUT_ATTRIBUTE_COUNT;
+	header.vertexLayout = static_cast<uint32_t>(layout);
+	for (const VertexLayoutAttribute& attribute : layoutAttributes)
+	{
+		attributes.push_back({ attribute.location, static_cast<uint32_t>(attribute.format), attribute.offset, 0 });
+	}
+
+	std::vector<MeshBlobSubmesh> submeshes;
+	std::vector<char> data;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) continue;		// points and lines are split off by SortByPType
+
+		std::vector<BakedVertex> vertices(mesh->mNumVertices);
+		for (unsigned int v = 0; v < mesh->mNumVertices; v++)
+		{
+			BakedVertex& vertex = vertices[v];
+			vertex.position[0] = mesh->mVertices[v].x;
+			vertex.position[1] = mesh->mVertices[v].y;
+			vertex.position[2] = mesh->mVertices[v].z;
+
+			aiColor4D color = mesh->HasVertexColors(0) ? mesh->mColors[0][v] : aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+			vertex.color[0] = color.r;
+			vertex.color[1] = color.g;
+			vertex.color[2] = color.b;
+
+			vertex.coordinates[0] = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][v].x : 0.0f;
+			vertex.coordinates[1] = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][v].y : 0.0f;
+		}
+
+		std::vector<uint32_t> indices;
+		indices.reserve(mesh->mNumFaces * 3);
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+		{
+			indices.insert(indices.end(), mesh->mFaces[f].mIndices, mesh->mFaces[f].mIndices + mesh->mFaces[f].mNumIndices);
+		}
+
+		// same passes as the renderer runs on import: vertex cache, overdraw, vertex fetch
+		MeshOptimizeStats stats = optimizeMesh(vertices.data(), vertices.size(), sizeof(BakedVertex), indices.data(), indices.size());
+
+		MeshBlobSubmesh submesh = {};
+		submesh.vertexCount = static_cast<uint32_t>(vertices.size());
+		submesh.indexCount = static_cast<uint32_t>(indices.size());
+
+		// streams shrink in place, only their leading bytes are written
+		uint32_t stride = packVertices(vertices.data(), vertices.size(), layout, &submesh.quantization);
+		submesh.indexType = packIndices(indices.data(), indices.size(), vertices.size());
+
+		aiString texturePath;
+		const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+		if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0 && material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) == AI_SUCCESS)
+		{
+			std::string name = bakedTextureName(texturePath.C_Str());
+			memcpy(submesh.texture, name.c_str(), name.size() + 1);
+		}
+
+		submesh.vertexOffset = alignBlobOffset(data.size());
+		data.resize(submesh.vertexOffset);
+		appendBlob(data, reinterpret_cast<const char*>(vertices.data()), vertices.size() * stride);
+		submesh.indexOffset = alignBlobOffset(data.size());
+		data.resize(submesh.indexOffset);
+		appendBlob(data, reinterpret_cast<const char*>(indices.data()), indices.size() * indexTypeSize(static_cast<VkIndexType>(submesh.indexType)));
+
+		submeshes.push_back(submesh);
+		printf("  submesh %zu: %u vertices, %u triangles, %u bit indices, ACMR %.3f -> %.3f, texture '%s'\n", submeshes.size() - 1, submesh.vertexCount,
+			submesh.indexCount / 3, indexTypeSize(static_cast<VkIndexType>(submesh.indexType)) * 8, stats.acmrBefore, stats.acmrAfter, submesh.texture);
+	}
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+
+	std::vector<char> tables;
+	appendBlob(tables, &header);
+	appendBlob(tables, attributes.data(), attributes.size());
+	appendBlob(tables, submeshes.data(), submeshes.size());
+	writeAssetBlob(outputFile, AssetType::Mesh, tables, data);
+
+	printf("%s: %u submeshes, %zu KB\n", outputFile.c_str(), header.submeshCount, data.size() / 1024);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+#include "../VertexPacking.h"
+
+// Imports a model with assimp (obj, fbx, gltf...) and writes a mesh blob with one submesh per assimp mesh
+// Node transforms are baked into the vertices, diffuse texture names are rewritten to their baked texture blob names
+// layout has to be the vertexLayout the renderer is configured with
+void bakeMesh(const std::string& inputFile, const std::string& outputFile, VertexLayout layout);
@@ -0,0 +1,97 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include "TextureBaker.h"
+#include "BlockCompression.h"
+#include "../AssetBlob.h"
+
+#include <cstdio>
+#include <algorithm>
+
+// Next level by averaging 2x2 texels, odd sizes repeat their last row / column
+static std::vector<uint8_t> downsample(const std::vector<uint8_t>& level, uint32_t width, uint32_t height, uint32_t nextWidth, uint32_t nextHeight)
+{
+	std::vector<uint8_t> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+	for (uint32_t y = 0; y < nextHeight; y++)
+	{
+		for (uint32_t x = 0; x < nextWidth; x++)
+		{
+			uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				uint32_t sum = level[(y0 * width + x0) * 4 + c] + level[(y0 * width + x1) * 4 + c]
+					+ level[(y1 * width + x0) * 4 + c] + level[(y1 * width + x1) * 4 + c];
+				next[(y * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+	return next;
+}
+
+void bakeTexture(const std::string& inputFile, const std::string& outputFile, TextureEncoding encoding)
+{
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(inputFile.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		throw std::runtime_error("Failed to load " + inputFile + " (" + stbi_failure_reason() + ")");
+	}
+	std::vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+
+	if (encoding == TextureEncoding::Auto)
+	{
+		bool translucent = false;
+		for (size_t i = 3; i < level.size() && !translucent; i += 4) translucent = level[i] != 255;
+		encoding = translucent ? TextureEncoding::Bc3 : TextureEncoding::Bc1;
+	}
+
+	TextureBlobHeader header = {};
+	header.format = encoding == TextureEncoding::Bc1 ? VK_FORMAT_BC1_RGB_UNORM_BLOCK
+		: encoding == TextureEncoding::Bc3 ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+
+	// full chain down to 1x1, largest level first
+	std::vector<TextureBlobLevel> levels;
+	std::vector<char> data;
+	uint32_t levelWidth = header.width;
+	uint32_t levelHeight = header.height;
+	while (true)
+	{
+		std::vector<char> encoded;
+		switch (encoding)
+		{
+		case TextureEncoding::Bc1: encoded = compressBc1(level.data(), levelWidth, levelHeight); break;
+		case TextureEncoding::Bc3: encoded = compressBc3(level.data(), levelWidth, levelHeight); break;
+		default: encoded.assign(level.begin(), level.end()); break;
+		}
+
+		TextureBlobLevel blobLevel = {};
+		blobLevel.offset = alignBlobOffset(data.size());
+		blobLevel.size = encoded.size();
+		blobLevel.width = levelWidth;
+		blobLevel.height = levelHeight;
+		levels.push_back(blobLevel);
+
+		data.resize(blobLevel.offset);
+		data.insert(data.end(), encoded.begin(), encoded.end());
+
+		if (levelWidth == 1 && levelHeight == 1) break;
+		uint32_t nextWidth = std::max(levelWidth / 2, 1u);
+		uint32_t nextHeight = std::max(levelHeight / 2, 1u);
+		level = downsample(level, levelWidth, levelHeight, nextWidth, nextHeight);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+	header.levelCount = static_cast<uint32_t>(levels.size());
+
+	std::vector<char> tables;
+	appendBlob(tables, &header);
+	appendBlob(tables, levels.data(), levels.size());
+	writeAssetBlob(outputFile, AssetType::Texture, tables, data);
+
+	printf("%s: %ux%u, %u levels, %zu KB (%zu KB as RGBA8)\n", outputFile.c_str(), header.width, header.height, header.levelCount,
+		data.size() / 1024, static_cast<size_t>(width) * height * 4 * 4 / 3 / 1024);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+enum class TextureEncoding
+{
+	Auto,				// BC3 if any texel is translucent, BC1 otherwise
+	Bc1,
+	Bc3,
+	Rgba8				// uncompressed, still gets the mip chain
+};
+
+// Decodes an image (png, jpg, tga, bmp...), builds its full mip chain and writes a texture blob
+void bakeTexture(const std::string& inputFile, const std::string& outputFile, TextureEncoding encoding);
@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <string>
+#include <stdexcept>
+
+#include "TextureBaker.h"
+#include "MeshBaker.h"
+#include "../AssetBlob.h"
+
+// AssetBaker <input> [output] [--format auto|bc1|bc3|rgba8] [--layout packed|half|float]
+// Images become texture blobs (output defaults to <input name>.texblob), everything else is imported as a mesh (<input name>.meshblob)
+// Put the results in Textures/ and Models/ next to the renderer
+static bool isImageFile(const std::string& fileName)
+{
+	for (const char* extension : { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif", ".hdr" })
+	{
+		if (hasFileExtension(fileName, extension)) return true;
+	}
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string input;
+	std::string output;
+	TextureEncoding encoding = TextureEncoding::Auto;
+	VertexLayout layout = VertexLayout::Packed;
+	bool validArguments = true;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc)
+		{
+			std::string format = argv[++i];
+			encoding = format == "bc1" ? TextureEncoding::Bc1 : format == "bc3" ? TextureEncoding::Bc3
+				: format == "rgba8" ? TextureEncoding::Rgba8 : TextureEncoding::Auto;
+		}
+		else if (arg == "--layout" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "packed") layout = VertexLayout::Packed;
+			else if (name == "half") layout = VertexLayout::HalfPosition;
+			else if (name == "float") layout = VertexLayout::Float;
+			else
+			{
+				printf("unknown vertex layout %s\n", name.c_str());
+				validArguments = false;
+			}
+		}
+		else if (input.empty()) input = arg;
+		else output = arg;
+	}
+
+	if (input.empty() || !validArguments)
+	{
+		printf("usage: AssetBaker <input> [output] [--format auto|bc1|bc3|rgba8] [--layout packed|half|float]\n");
+		return EXIT_FAILURE;
+	}
+
+	bool image = isImageFile(input);
+	if (output.empty())
+	{
+		std::string name = input.substr(input.find_last_of("/\\") + 1);
+		output = name.substr(0, name.find_last_of('.')) + (image ? TEXTURE_BLOB_EXTENSION : MESH_BLOB_EXTENSION);
+	}
+
+	try {
+		if (image) bakeTexture(input, output, encoding);
+		else bakeMesh(input, output, layout);
+	}
+	catch (const std::runtime_error& e) {
+		printf("ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
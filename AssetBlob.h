@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "VertexPacking.h"
+
+// Baked asset files written by AssetBaker and read by the renderer without any conversion
+// Layout: AssetBlobHeader, type specific header and tables, then the data section starting at headerSize
+// Offsets in the tables are relative to the data section and aligned to ASSET_BLOB_ALIGNMENT, all little endian
+const uint32_t ASSET_BLOB_MAGIC = 0x42415356;					// "VSAB"
+const uint32_t ASSET_BLOB_VERSION = 3;
+const uint64_t ASSET_BLOB_ALIGNMENT = 16;						// covers every texel block size and the 4 byte copy offset rule
+const size_t ASSET_BLOB_NAME_SIZE = 64;
+const char* const TEXTURE_BLOB_EXTENSION = ".texblob";
+const char* const MESH_BLOB_EXTENSION = ".meshblob";
+
+enum class AssetType : uint32_t
+{
+	Texture = 1,
+	Mesh = 2
+};
+
+struct AssetBlobHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	AssetType type;
+	uint32_t headerSize;			// bytes before the data section
+	uint64_t dataSize;
+};
+
+// Texture: AssetBlobHeader, TextureBlobHeader, TextureBlobLevel[levelCount], level data (largest level first)
+struct TextureBlobHeader
+{
+	uint32_t format;				// VkFormat the levels are stored in
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+};
+struct TextureBlobLevel
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Mesh: AssetBlobHeader, MeshBlobHeader, MeshBlobAttribute[attributeCount], MeshBlobSubmesh[submeshCount],
+// then per submesh its vertex stream and index stream
+struct MeshBlobHeader
+{
+	uint32_t vertexStride;
+	uint32_t attributeCount;
+	uint32_t vertexLayout;			// VertexLayout the streams were written with
+	uint32_t submeshCount;
+	uint64_t sourceHash;			// runtime mesh cache: source file and vertex layout it was imported from, 0 when baked
+};
+struct MeshBlobAttribute
+{
+	uint32_t location;
+	uint32_t format;				// VkFormat
+	uint32_t offset;
+	uint32_t padding;
+};
+struct MeshBlobSubmesh
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexType;				// VkIndexType, 16 bit whenever the vertex count allows it
+	uint32_t padding;
+	PositionQuantization quantization;		// identity for the float layout
+	char texture[ASSET_BLOB_NAME_SIZE];		// file in Textures/, empty when the material has none
+};
+
+static_assert(sizeof(AssetBlobHeader) == 24 && sizeof(TextureBlobLevel) == 24 && sizeof(MeshBlobHeader) == 24 && sizeof(MeshBlobSubmesh) == 120,
+	"Asset blob structs must not contain padding");
+
+static uint64_t alignBlobOffset(uint64_t offset)
+{
+	return (offset + ASSET_BLOB_ALIGNMENT - 1) & ~(ASSET_BLOB_ALIGNMENT - 1);
+}
+
+static bool hasFileExtension(const std::string& fileName, const char* extension)
+{
+	size_t length = strlen(extension);
+	return fileName.size() > length && fileName.compare(fileName.size() - length, length, extension) == 0;
+}
+
+// Checks the common header against the file size, returns the data section
+static const char* checkAssetBlob(const char* blob, size_t blobSize, AssetType type, const std::string& fileName)
+{
+	if (blobSize < sizeof(AssetBlobHeader))
+	{
+		throw std::runtime_error("Asset blob is too small! (" + fileName + ")");
+	}
+
+	const AssetBlobHeader* header = reinterpret_cast<const AssetBlobHeader*>(blob);
+	if (header->magic != ASSET_BLOB_MAGIC || header->type != type)
+	{
+		throw std::runtime_error("Not a baked asset of the expected type! (" + fileName + ")");
+	}
+	if (header->version != ASSET_BLOB_VERSION)
+	{
+		throw std::runtime_error("Asset blob was baked by a different baker version, bake it again! (" + fileName + ")");
+	}
+	if (header->headerSize > blobSize || header->dataSize > blobSize - header->headerSize)
+	{
+		throw std::runtime_error("Asset blob is truncated! (" + fileName + ")");
+	}
+	return blob + header->headerSize;
+}
+
+// tables: type specific header and tables, data: the data section with offsets as referenced by the tables
+static void writeAssetBlob(const std::string& fileName, AssetType type, const std::vector<char>& tables, const std::vector<char>& data)
+{
+	AssetBlobHeader header = {};
+	header.magic = ASSET_BLOB_MAGIC;
+	header.version = ASSET_BLOB_VERSION;
+	header.type = type;
+	header.headerSize = static_cast<uint32_t>(alignBlobOffset(sizeof(AssetBlobHeader) + tables.size()));
+	header.dataSize = data.size();
+
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open " + fileName + " for writing!");
+	}
+
+	std::vector<char> padding(header.headerSize - sizeof(AssetBlobHeader) - tables.size(), 0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(tables.data(), tables.size());
+	file.write(padding.data(), padding.size());
+	file.write(data.data(), data.size());
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write " + fileName + "!");
+	}
+}
+
+// Appends a plain struct or array to a table or data buffer
+template<typename T>
+static void appendBlob(std::vector<char>& buffer, const T* values, size_t count = 1)
+{
+	const char* bytes = reinterpret_cast<const char*>(values);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * count);
+}
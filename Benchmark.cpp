@@ -0,0 +1,145 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+Benchmark::Benchmark(Window& window, VkRenderer& renderer, const BenchmarkSettings& settings) :
+	window(window), renderer(renderer), settings(settings)
+{
+}
+
+// Frame count of a command line option, the default is kept when the value is not a number
+static uint32_t parseFrameCount(const std::string& option, const std::string& value, uint32_t defaultFrames)
+{
+	try
+	{
+		return static_cast<uint32_t>(std::stoul(value));
+	}
+	catch (const std::exception&)
+	{
+		printf("invalid frame count %s for %s, using %u\n", value.c_str(), option.c_str(), defaultFrames);
+		return defaultFrames;
+	}
+}
+
+bool Benchmark::parseArguments(int argc, char* argv[], BenchmarkSettings* settings)
+{
+	bool benchmark = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--benchmark")
+		{
+			benchmark = true;
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			settings->warmupFrames = parseFrameCount(arg, argv[++i], settings->warmupFrames);
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			settings->measuredFrames = parseFrameCount(arg, argv[++i], settings->measuredFrames);
+		}
+		else if (arg == "--out" && hasValue)
+		{
+			settings->outputFile = argv[++i];
+		}
+	}
+	return benchmark;
+}
+
+void Benchmark::run(const std::function<void(float)>& updateScene)
+{
+	cpuFrameTimes.reserve(settings.measuredFrames);
+	drawBlockedTimes.reserve(settings.measuredFrames);
+	gpuTimes.reserve(settings.measuredFrames);
+
+	uint32_t totalFrames = settings.warmupFrames + settings.measuredFrames;
+	for (uint32_t frame = 0; frame < totalFrames && window.IsRunning(); frame++)
+	{
+		auto frameStart = std::chrono::steady_clock::now();
+
+		glfwPollEvents();
+		updateScene(settings.fixedTimeStep);
+		renderer.draw();
+
+		auto frameEnd = std::chrono::steady_clock::now();
+
+		if (frame < settings.warmupFrames) continue;
+
+		const FrameTimings& timings = renderer.getFrameTimings();
+		cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		drawBlockedTimes.push_back(timings.drawBlockedMs);
+
+		// gpu time arrives MAX_FRAME_DRAWS frames late, the warm up frames cover that delay
+		if (timings.gpuValid)
+		{
+			gpuTimes.push_back(timings.gpuMs);
+		}
+	}
+}
+
+void Benchmark::writeReport() const
+{
+	std::ofstream out(settings.outputFile, std::ios::trunc);
+	if (!out.is_open())
+	{
+		throw std::runtime_error("Failed to open benchmark output file! (" + settings.outputFile + ")");
+	}
+
+	out << "{\n";
+	out << "\t\"warmupFrames\": " << settings.warmupFrames << ",\n";
+	out << "\t\"measuredFrames\": " << cpuFrameTimes.size() << ",\n";
+	out << "\t\"fixedTimeStep\": " << settings.fixedTimeStep << ",\n";
+	writeStats(out, "cpuFrameMs", cpuFrameTimes, false);
+	writeStats(out, "drawBlockedMs", drawBlockedTimes, false);
+	writeStats(out, "gpuMs", gpuTimes, true);
+	out << "}\n";
+
+	Stats cpu = computeStats(cpuFrameTimes);
+	printf("Benchmark: %zu frames, cpu mean %.3f ms, p99 %.3f ms -> %s\n", cpuFrameTimes.size(), cpu.mean, cpu.p99, settings.outputFile.c_str());
+}
+
+Benchmark::Stats Benchmark::computeStats(std::vector<double> samples)
+{
+	Stats stats;
+	if (samples.empty()) return stats;
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+	stats.mean = sum / samples.size();
+
+	// nearest rank percentile on the sorted samples
+	auto percentile = [&samples](double p)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+	stats.p50 = percentile(50.0);
+	stats.p95 = percentile(95.0);
+	stats.p99 = percentile(99.0);
+	stats.max = samples.back();
+
+	return stats;
+}
+
+void Benchmark::writeStats(std::ofstream& out, const char* name, const std::vector<double>& samples, bool last)
+{
+	Stats stats = computeStats(samples);
+	out << "\t\"" << name << "\": { "
+		<< "\"samples\": " << samples.size() << ", "
+		<< "\"mean\": " << stats.mean << ", "
+		<< "\"p50\": " << stats.p50 << ", "
+		<< "\"p95\": " << stats.p95 << ", "
+		<< "\"p99\": " << stats.p99 << ", "
+		<< "\"max\": " << stats.max << " }"
+		<< (last ? "\n" : ",\n");
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <cmath>
+
+#include "VkRenderer.h"
+#include "Window.h"
+
+struct BenchmarkSettings
+{
+	uint32_t warmupFrames = 120;				// frames rendered before anything is recorded (pipelines, caches, clocks settle)
+	uint32_t measuredFrames = 1000;				// frames recorded into the report
+	float fixedTimeStep = 1.0f / 60.0f;			// scene always advances by this much, so every run renders the same frames
+	std::string outputFile = "benchmark.json";
+};
+
+// Drives the scene with a fixed time step for a fixed number of frames and reports frame time percentiles as JSON
+class Benchmark
+{
+public:
+	Benchmark(Window& window, VkRenderer& renderer, const BenchmarkSettings& settings);
+
+	// Returns true if the command line asked for a benchmark run (--benchmark [--warmup N] [--frames M] [--out file])
+	static bool parseArguments(int argc, char* argv[], BenchmarkSettings* settings);
+
+	void run(const std::function<void(float)>& updateScene);
+	void writeReport() const;
+
+private:
+	struct Stats
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	Window& window;
+	VkRenderer& renderer;
+	BenchmarkSettings settings;
+
+	std::vector<double> cpuFrameTimes;			// whole loop iteration (poll, update, draw)
+	std::vector<double> drawBlockedTimes;		// time draw() waited on fences and the swapchain
+	std::vector<double> gpuTimes;				// command buffer execution time from timestamp queries
+
+	static Stats computeStats(std::vector<double> samples);
+	static void writeStats(std::ofstream& out, const char* name, const std::vector<double>& samples, bool last);
+};
@@ -0,0 +1,114 @@
+#include "DescriptorLayoutCache.h"
+
+#include <algorithm>
+
+DescriptorLayoutCache::DescriptorLayoutCache(Device device) : device(device)
+{
+}
+
+DescriptorLayoutCache::~DescriptorLayoutCache()
+{
+	for (const auto& entry : pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(device.logical, entry.second.layout, nullptr);
+	}
+	for (const auto& entry : setLayouts)
+	{
+		vkDestroyDescriptorSetLayout(device.logical, entry.second.layout, nullptr);
+	}
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+	std::sort(sorted.begin(), sorted.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	// hashed field by field, the struct has padding and a pointer
+	size_t bindingCount = sorted.size();
+	uint64_t hash = hashFnv1a(&bindingCount, sizeof(bindingCount));
+	for (const VkDescriptorSetLayoutBinding& binding : sorted)
+	{
+		if (binding.pImmutableSamplers != nullptr)
+		{
+			throw std::runtime_error("Immutable samplers are not supported by the layout cache!");
+		}
+		hash = hashFnv1a(&binding.binding, sizeof(binding.binding), hash);
+		hash = hashFnv1a(&binding.descriptorType, sizeof(binding.descriptorType), hash);
+		hash = hashFnv1a(&binding.descriptorCount, sizeof(binding.descriptorCount), hash);
+		hash = hashFnv1a(&binding.stageFlags, sizeof(binding.stageFlags), hash);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = setLayouts.equal_range(hash);
+	for (auto entry = range.first; entry != range.second; ++entry)
+	{
+		if (equalBindings(entry->second.bindings, sorted))
+		{
+			reuseCount++;
+			return entry->second.layout;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(sorted.size());
+	layoutCreateInfo.pBindings = sorted.data();
+
+	VkDescriptorSetLayout layout;
+	VkResult result = vkCreateDescriptorSetLayout(device.logical, &layoutCreateInfo, nullptr, &layout);
+	checkResult(result, "Failed to create descriptor set layout");
+
+	setLayouts.insert({ hash, { sorted, layout } });
+	return layout;
+}
+
+VkPipelineLayout DescriptorLayoutCache::getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+	uint64_t hash = hashFnv1a(setLayouts.data(), setLayouts.size() * sizeof(VkDescriptorSetLayout));
+	for (const VkPushConstantRange& range : pushConstantRanges)
+	{
+		hash = hashFnv1a(&range, sizeof(range), hash);					// three 32 bit fields, no padding
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = pipelineLayouts.equal_range(hash);
+	for (auto entry = range.first; entry != range.second; ++entry)
+	{
+		if (entry->second.setLayouts == setLayouts && equalRanges(entry->second.pushConstantRanges, pushConstantRanges))
+		{
+			reuseCount++;
+			return entry->second.layout;
+		}
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+	VkPipelineLayout layout;
+	VkResult result = vkCreatePipelineLayout(device.logical, &pipelineLayoutInfo, nullptr, &layout);
+	checkResult(result, "Failed to create pipeline layout");
+
+	pipelineLayouts.insert({ hash, { setLayouts, pushConstantRanges, layout } });
+	return layout;
+}
+
+bool DescriptorLayoutCache::equalBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const VkDescriptorSetLayoutBinding& x, const VkDescriptorSetLayoutBinding& y)
+	{
+		return x.binding == y.binding && x.descriptorType == y.descriptorType && x.descriptorCount == y.descriptorCount && x.stageFlags == y.stageFlags;
+	});
+}
+
+bool DescriptorLayoutCache::equalRanges(const std::vector<VkPushConstantRange>& a, const std::vector<VkPushConstantRange>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const VkPushConstantRange& x, const VkPushConstantRange& y)
+	{
+		return x.stageFlags == y.stageFlags && x.offset == y.offset && x.size == y.size;
+	});
+}
@@ -0,0 +1,51 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Owns every descriptor set layout and pipeline layout, identical descriptions get the same handle
+// Pipelines built from the same layouts are layout compatible, so bound descriptor sets stay valid when switching between them
+class DescriptorLayoutCache
+{
+public:
+	DescriptorLayoutCache(Device device);
+	~DescriptorLayoutCache();
+
+	// Bindings in any order, immutable samplers are not supported
+	VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+#pragma region getters
+	size_t getSetLayoutCount() const { return setLayouts.size(); }
+	size_t getPipelineLayoutCount() const { return pipelineLayouts.size(); }
+	size_t getReuseCount() const { return reuseCount; }				// requests answered with an existing layout
+#pragma endregion
+
+private:
+	struct SetLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings;			// sorted by binding number
+		VkDescriptorSetLayout layout;
+	};
+	struct PipelineLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayout> setLayouts;				// already deduplicated, so compared by handle
+		std::vector<VkPushConstantRange> pushConstantRanges;
+		VkPipelineLayout layout;
+	};
+
+	Device device;
+	std::unordered_multimap<uint64_t, SetLayoutEntry> setLayouts;			// by hash of the description
+	std::unordered_multimap<uint64_t, PipelineLayoutEntry> pipelineLayouts;
+	size_t reuseCount = 0;
+	std::mutex mutex;
+
+	static bool equalBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b);
+	static bool equalRanges(const std::vector<VkPushConstantRange>& a, const std::vector<VkPushConstantRange>& b);
+};
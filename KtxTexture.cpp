@@ -0,0 +1,107 @@
+#include "KtxTexture.h"
+
+#include <cstring>
+#include <algorithm>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// File layout up to the level index, all little endian
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+struct Ktx2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+KtxTexture::KtxTexture(const std::string& fileName) : file(fileName)
+{
+	const char* fileData = file.getData();
+	size_t fileSize = file.getSize();
+
+	Ktx2Header header;
+	if (fileSize < sizeof(header))
+	{
+		throw std::runtime_error("KTX2 file is too small! (" + fileName + ")");
+	}
+	memcpy(&header, fileData, sizeof(header));
+
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		throw std::runtime_error("Not a KTX2 file! (" + fileName + ")");
+	}
+	if (header.vkFormat == VK_FORMAT_UNDEFINED || header.supercompressionScheme != 0)
+	{
+		throw std::runtime_error("Supercompressed KTX2 files are not supported! (" + fileName + ")");
+	}
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+	{
+		throw std::runtime_error("Only single 2D KTX2 textures are supported! (" + fileName + ")");
+	}
+
+	format = static_cast<VkFormat>(header.vkFormat);
+	width = header.pixelWidth;
+	height = header.pixelHeight;
+
+	// 0 asks the loader to generate mips, block compressed data can't be blitted so only level 0 is used
+	uint32_t levelCount = std::max(header.levelCount, 1u);
+	if (levelCount > mipLevelCount(width, height))
+	{
+		throw std::runtime_error("KTX2 file has more levels than its extent allows! (" + fileName + ")");
+	}
+	size_t indexEnd = sizeof(header) + levelCount * sizeof(Ktx2LevelIndex);
+	if (fileSize < indexEnd)
+	{
+		throw std::runtime_error("KTX2 level index is truncated! (" + fileName + ")");
+	}
+
+	// levels are stored smallest first, so the level data starts at the last level. Offsets in the file are aligned
+	// to the texel block size and 4 bytes, relative to the first level they still are
+	std::vector<Ktx2LevelIndex> levelIndex(levelCount);
+	memcpy(levelIndex.data(), fileData + sizeof(header), levelCount * sizeof(Ktx2LevelIndex));
+
+	dataOffset = fileSize;
+	for (const Ktx2LevelIndex& level : levelIndex)
+	{
+		if (level.byteLength == 0 || level.byteLength > fileSize || level.byteOffset > fileSize - level.byteLength)
+		{
+			throw std::runtime_error("KTX2 level data is out of the file! (" + fileName + ")");
+		}
+		dataOffset = std::min(dataOffset, static_cast<size_t>(level.byteOffset));
+	}
+
+	// sizes against format and extent are checked by the upload, which blob textures go through as well
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		TextureLevel level;
+		level.offset = levelIndex[i].byteOffset - dataOffset;
+		level.size = levelIndex[i].byteLength;
+		level.width = std::max(width >> i, 1u);
+		level.height = std::max(height >> i, 1u);
+		levels.push_back(level);
+	}
+}
+
+bool KtxTexture::isKtxFile(const std::string& fileName)
+{
+	return fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".ktx2") == 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "Utilities.h"
+#include "MappedFile.h"
+
+// 2D texture from a KTX2 container (Khronos KTX 2.0 specification), data stays in the format it was baked in
+// so block compressed mip chains (BC1/3/5/7, ETC2, ASTC) go to the GPU without decoding
+// Supercompressed files (Basis, zstd), arrays, cube maps and 3D textures are rejected
+class KtxTexture
+{
+public:
+	KtxTexture(const std::string& fileName);
+
+	static bool isKtxFile(const std::string& fileName);
+
+#pragma region getters
+	VkFormat getFormat() const { return format; }
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	const std::vector<TextureLevel>& getLevels() const { return levels; }	// level 0 is the full size one
+	const char* getData() const { return file.getData() + dataOffset; }
+	VkDeviceSize getDataSize() const { return file.getSize() - dataOffset; }
+#pragma endregion
+
+private:
+	MappedFile file;
+	size_t dataOffset = 0;					// first byte of level data, everything before is headers
+
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	std::vector<TextureLevel> levels;
+};
@@ -0,0 +1,76 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& fileName)
+{
+	fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		fileHandle = nullptr;
+		throw std::runtime_error("Failed to open a file! (" + fileName + ")");
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size == 0) return;						// empty files can't be mapped
+
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle != nullptr)
+	{
+		data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (data == nullptr)
+	{
+		if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		throw std::runtime_error("Failed to map a file! (" + fileName + ")");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr) UnmapViewOfFile(data);
+	if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+	if (fileHandle != nullptr) CloseHandle(fileHandle);
+}
+#else
+MappedFile::MappedFile(const std::string& fileName)
+{
+	fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		throw std::runtime_error("Failed to open a file! (" + fileName + ")");
+	}
+
+	struct stat fileStat;
+	fstat(fileDescriptor, &fileStat);
+	size = static_cast<size_t>(fileStat.st_size);
+	if (size == 0) return;						// empty files can't be mapped
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(fileDescriptor);
+		throw std::runtime_error("Failed to map a file! (" + fileName + ")");
+	}
+	data = static_cast<const char*>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr) munmap(const_cast<char*>(data), size);
+	if (fileDescriptor >= 0) close(fileDescriptor);
+}
+#endif
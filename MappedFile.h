@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+
+// Read only view of a whole file, pages are loaded by the OS on first access
+class MappedFile
+{
+public:
+	MappedFile(const std::string& fileName);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+#pragma region getters
+	const char* getData() const { return data; }
+	size_t getSize() const { return size; }
+#pragma endregion
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
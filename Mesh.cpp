@@ -1,13 +1,30 @@
 #include "Mesh.h"
 
-Mesh::Mesh(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, size_t texId) :
+Mesh::Mesh(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, const void* vertexData, VkDeviceSize vertexDataSize, size_t vertexCount,
+	const void* indexData, VkDeviceSize indexDataSize, size_t indexCount, size_t texId) :
 	device(device), texId(texId)
 {
-	vertex = MeshData(device, transferQueue, transferCmdPool, vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-	index = MeshData(device, transferQueue, transferCmdPool, indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	vertex = MeshData(device, transferQueue, transferCmdPool, vertexData, vertexDataSize, vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	index = MeshData(device, transferQueue, transferCmdPool, indexData, indexDataSize, indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 	modelMatrix = glm::mat4(1.0f);
 }
 
+Mesh::Mesh(Device device, VkCommandBuffer transferCmdBuffer, VkBuffer srcBuffer, VkDeviceSize vertexOffset, VkDeviceSize vertexDataSize, size_t vertexCount,
+	VkDeviceSize indexOffset, VkDeviceSize indexDataSize, size_t indexCount, size_t texId) :
+	device(device), texId(texId)
+{
+	vertex = MeshData(device, transferCmdBuffer, srcBuffer, vertexOffset, vertexDataSize, vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	index = MeshData(device, transferCmdBuffer, srcBuffer, indexOffset, indexDataSize, indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	modelMatrix = glm::mat4(1.0f);
+}
+
+void Mesh::setPositionQuantization(const PositionQuantization& quantization)
+{
+	glm::vec3 scale(quantization.scale[0], quantization.scale[1], quantization.scale[2]);
+	glm::vec3 bias(quantization.bias[0], quantization.bias[1], quantization.bias[2]);
+	positionTransform = glm::scale(glm::translate(glm::mat4(1.0f), bias), scale);
+}
+
 Mesh::~Mesh()
 {
 	cleanUp();
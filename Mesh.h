@@ -10,19 +10,31 @@
 class Mesh
 {
 public:
-    Mesh(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, size_t texId);
+    // Streams already in the GPU layout (packed by VkRenderer::createPackedMesh, or a mapped mesh blob), copied into staging as they are
+    Mesh(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, const void* vertexData, VkDeviceSize vertexDataSize, size_t vertexCount,
+        const void* indexData, VkDeviceSize indexDataSize, size_t indexCount, size_t texId);
+    // Streams already written to a staging buffer, the copies are recorded into transferCmdBuffer and the caller submits them
+    Mesh(Device device, VkCommandBuffer transferCmdBuffer, VkBuffer srcBuffer, VkDeviceSize vertexOffset, VkDeviceSize vertexDataSize, size_t vertexCount,
+        VkDeviceSize indexOffset, VkDeviceSize indexDataSize, size_t indexCount, size_t texId);
     ~Mesh();
     
     void cleanUp();
     void setModel(glm::mat4 model) { this->modelMatrix = model; }
+    void setFeatures(PipelineFeatures features) { this->features = features; }
+    void setIndexType(VkIndexType indexType) { this->indexType = indexType; }
+    // Packed positions are stored relative to the mesh bounds, the transform back is applied after the model matrix
+    void setPositionQuantization(const PositionQuantization& quantization);
 
 #pragma region getters
     const size_t getTexId()             const { return texId; }
     const glm::mat4& getModel()         const { return modelMatrix; }
+    PipelineFeatures getFeatures()      const { return features; }
     const size_t& getVertexCount()      const { return vertex.count; }
     const VkBuffer& getVertexBuffer()   const { return vertex.buffer; }
     const size_t& getIndexCount()       const { return index.count; }
     const VkBuffer& getIndexBuffer()    const { return index.buffer; }
+    VkIndexType getIndexType()          const { return indexType; }
+    const glm::mat4& getPositionTransform() const { return positionTransform; }
 #pragma endregion
 
 private:
@@ -34,12 +46,9 @@ private:
 
         MeshData() : count(0), buffer(VK_NULL_HANDLE), bufferMemory(VK_NULL_HANDLE) {}
 
-        template<typename T>
-        MeshData(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, std::vector<T>* data, VkBufferUsageFlagBits bufferType) 
+        MeshData(Device device, VkQueue transferQueue, VkCommandPool transferCmdPool, const void* data, VkDeviceSize bufferSize, size_t count, VkBufferUsageFlagBits bufferType) :
+            count(count)
         {
-            count = data->size();
-            // Get size of buffer needed for vertices
-            VkDeviceSize bufferSize = sizeof(Vertex) * count;
 
             // Temporary buffer to "stage" vertex data before transferring to GPU
             VkBuffer stagingBuffer;
@@ -54,7 +63,7 @@ private:
             // MAP MEMORY TO VERTEX BUFFER
             void* mappedData;  // 1. Create pointer to a point in normal memory
             vkMapMemory(device.logical, stagingBufferMemory, 0, bufferSize, 0, &mappedData);  // 2. "Map" the vertex buffer memory to that point
-            memcpy(mappedData, data->data(), (size_t)bufferSize);  // 3. Copy memory from vertices vector to the point
+            memcpy(mappedData, data, (size_t)bufferSize);  // 3. Copy memory from vertices vector to the point
             vkUnmapMemory(device.logical, stagingBufferMemory);  // 4. Unmap the vertex buffer memory
 
             // Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
@@ -69,10 +78,27 @@ private:
             vkDestroyBuffer(device.logical, stagingBuffer, nullptr);
             vkFreeMemory(device.logical, stagingBufferMemory, nullptr);
         }
+
+        MeshData(Device device, VkCommandBuffer transferCmdBuffer, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkDeviceSize bufferSize, size_t count,
+            VkBufferUsageFlagBits bufferType) :
+            count(count)
+        {
+            createBuffer(device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | bufferType,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, &bufferMemory);
+
+            VkBufferCopy bufferCopyRegion = {};
+            bufferCopyRegion.srcOffset = srcOffset;
+            bufferCopyRegion.dstOffset = 0;
+            bufferCopyRegion.size = bufferSize;
+            vkCmdCopyBuffer(transferCmdBuffer, srcBuffer, buffer, 1, &bufferCopyRegion);
+        }
     };
 
     glm::mat4 modelMatrix;
     size_t texId;
+    PipelineFeatures features = PIPELINE_FEATURES_DEFAULT;     // selects the pipeline variant the mesh is drawn with
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    glm::mat4 positionTransform = glm::mat4(1.0f);
 
     MeshData vertex;
     MeshData index;
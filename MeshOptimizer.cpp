@@ -0,0 +1,290 @@
+#include "MeshOptimizer.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Forsyth's scoring, cache positions past FORSYTH_CACHE_SIZE score nothing
+const int FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// the last triangle's vertices score a fixed value, reusing them right away favours strips, which caches don't need
+		if (cachePosition < 3)
+		{
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scaler = 1.0f - float(cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(scaler, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+	// vertices with few triangles left are finished first, so they don't end up as lone triangles later
+	score += FORSYTH_VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+	return score;
+}
+
+static const float* vertexPosition(const void* vertices, size_t vertexStride, uint32_t index)
+{
+	return reinterpret_cast<const float*>(static_cast<const char*>(vertices) + index * vertexStride);
+}
+
+float computeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	if (indexCount < 3) return 0.0f;
+
+	// a vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	size_t misses = 0;
+	size_t time = cacheSize + 1;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t index = indices[i];
+		if (time - loadedAt[index] > cacheSize)
+		{
+			loadedAt[index] = time++;
+			misses++;
+		}
+	}
+	return float(misses) / float(indexCount / 3);
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) return;
+
+	// -- ADJACENCY --
+	// triangles of each vertex, the first remaining[v] entries of its range are the ones not emitted yet
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++) remaining[indices[i]]++;
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(indexCount);
+	std::vector<uint32_t> filled(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (size_t k = 0; k < 3; k++)
+		{
+			uint32_t v = indices[t * 3 + k];
+			adjacency[adjacencyOffsets[v] + filled[v]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	// -- SCORES --
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) vertexScores[v] = vertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+	size_t deadEndCursor = 0;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// nothing in the cache has triangles left, continue with the next unused one in input order
+		if (bestTriangle == SIZE_MAX)
+		{
+			while (emitted[deadEndCursor]) deadEndCursor++;
+			bestTriangle = deadEndCursor;
+		}
+
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		// -- CACHE --
+		// the triangle's vertices go to the front, the rest keeps its order
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+		}
+		for (size_t k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			uint32_t* first = &adjacency[adjacencyOffsets[v]];
+			uint32_t* last = first + remaining[v];
+			std::iter_swap(std::find(first, last, static_cast<uint32_t>(bestTriangle)), last - 1);
+			remaining[v]--;
+		}
+		std::swap(cache, newCache);
+
+		// -- RESCORE --
+		// only vertices in the cache, or just pushed out of it, changed their score
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			uint32_t v = cache[i];
+			cachePositions[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+			vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+		}
+
+		bestTriangle = SIZE_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t v : cache)
+		{
+			for (uint32_t a = 0; a < remaining[v]; a++)
+			{
+				uint32_t t = adjacency[adjacencyOffsets[v] + a];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+		if (cache.size() > FORSYTH_CACHE_SIZE) cache.resize(FORSYTH_CACHE_SIZE);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t vertexStride, float threshold)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) return;
+
+	// -- CLUSTERS --
+	// a triangle missing all three vertices starts a cluster, reordering clusters keeps the misses inside them
+	std::vector<size_t> clusterStarts;
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	size_t time = ACMR_CACHE_SIZE + 1;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (size_t k = 0; k < 3; k++)
+		{
+			uint32_t index = indices[t * 3 + k];
+			if (time - loadedAt[index] > ACMR_CACHE_SIZE)
+			{
+				loadedAt[index] = time++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3) clusterStarts.push_back(t);
+	}
+	if (clusterStarts.size() < 2) return;
+	clusterStarts.push_back(triangleCount);
+
+	// -- SORT KEYS --
+	// clusters facing away from the mesh centre are in front of the rest from most directions
+	size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<float> centroids(clusterCount * 3, 0.0f);
+	std::vector<float> normals(clusterCount * 3, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float clusterArea = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const float* p0 = vertexPosition(vertices, vertexStride, indices[t * 3]);
+			const float* p1 = vertexPosition(vertices, vertexStride, indices[t * 3 + 1]);
+			const float* p2 = vertexPosition(vertices, vertexStride, indices[t * 3 + 2]);
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);		// twice the area, weights only
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				float centre = (p0[k] + p1[k] + p2[k]) / 3.0f;
+				centroids[c * 3 + k] += centre * area;
+				normals[c * 3 + k] += normal[k];
+				meshCentroid[k] += centre * area;
+			}
+			clusterArea += area;
+		}
+		for (size_t k = 0; k < 3 && clusterArea > 0.0f; k++) centroids[c * 3 + k] /= clusterArea;
+		meshArea += clusterArea;
+	}
+	for (size_t k = 0; k < 3 && meshArea > 0.0f; k++) meshCentroid[k] /= meshArea;
+
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		const float* normal = &normals[c * 3];
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float key = 0.0f;
+		for (size_t k = 0; k < 3 && length > 0.0f; k++) key += (centroids[c * 3 + k] - meshCentroid[k]) * normal[k] / length;
+		sortKeys[c] = key;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> reordered;
+	reordered.reserve(indexCount);
+	for (size_t c : order)
+	{
+		reordered.insert(reordered.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+	}
+
+	// vertices still cached across the old cluster boundaries are lost, keep the cache order if that costs too much
+	if (computeAcmr(reordered.data(), reordered.size(), vertexCount) > computeAcmr(indices, triangleCount * 3, vertexCount) * threshold) return;
+	std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+void optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexStride, uint32_t* indices, size_t indexCount)
+{
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		if (remap[indices[i]] == UINT32_MAX) remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == UINT32_MAX) remap[v] = next++;
+	}
+
+	std::vector<char> original(static_cast<const char*>(vertices), static_cast<const char*>(vertices) + vertexCount * vertexStride);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		memcpy(static_cast<char*>(vertices) + remap[v] * vertexStride, original.data() + v * vertexStride, vertexStride);
+	}
+}
+
+MeshOptimizeStats optimizeMesh(void* vertices, size_t vertexCount, size_t vertexStride, uint32_t* indices, size_t indexCount)
+{
+	MeshOptimizeStats stats = {};
+	stats.triangleCount = indexCount / 3;
+	stats.acmrBefore = computeAcmr(indices, indexCount, vertexCount);
+
+	optimizeVertexCache(indices, indexCount, vertexCount);
+	optimizeOverdraw(indices, indexCount, vertices, vertexCount, vertexStride);
+	optimizeVertexFetch(vertices, vertexCount, vertexStride, indices, indexCount);
+
+	stats.acmrAfter = computeAcmr(indices, indexCount, vertexCount);
+	return stats;
+}
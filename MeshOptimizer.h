@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Triangle and vertex reordering for indexed triangle lists, shared by the renderer and AssetBaker
+// Positions are read as three floats at the start of every vertex (Vertex in Utilities.h, BakedVertex in the baker)
+const uint32_t MESH_OPTIMIZER_VERSION = 1;			// part of the mesh cache key, cached meshes are reordered again when it changes
+const uint32_t ACMR_CACHE_SIZE = 16;				// FIFO post-transform cache the ACMR is measured with, a conservative size for current GPUs
+
+struct MeshOptimizeStats
+{
+	float acmrBefore;								// average cache misses per triangle, 0.5 is the ideal for large grids and 3 the worst
+	float acmrAfter;
+	size_t triangleCount;
+};
+
+// Vertex cache misses per triangle of a FIFO cache of cacheSize entries
+float computeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = ACMR_CACHE_SIZE);
+
+// Forsyth's linear speed vertex cache optimisation, reorders the triangles in place
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Splits the cache optimised order into clusters at cache flushes and draws outward facing clusters first, so they occlude the rest
+// The new order is dropped again when it raises the ACMR by more than threshold
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t vertexStride, float threshold = 1.05f);
+
+// Renumbers the vertices in the order the triangles first use them, unreferenced vertices move to the end. Vertices are moved in place
+void optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexStride, uint32_t* indices, size_t indexCount);
+
+// All three passes in order, safe to run on worker threads for different meshes
+MeshOptimizeStats optimizeMesh(void* vertices, size_t vertexCount, size_t vertexStride, uint32_t* indices, size_t indexCount);
@@ -1,24 +1,26 @@
 #include "Model.h"
 
-Model::Model()
+Model::Model() : model(glm::mat4(1.0f))
 {
 }
 
-Model::Model(std::vector<Mesh> meshes) : meshes(meshes), model(glm::mat4(1.0f)) {}
+Model::Model(std::vector<Mesh*> meshes) : meshes(meshes), model(glm::mat4(1.0f)) {}
 
-Model::~Model()
+Mesh* Model::getMesh(size_t index)
 {
-	for (Mesh& mesh : meshes)
+	if (index >= meshes.size())
 	{
-		mesh.cleanUp();
+		throw std::runtime_error("Attemppted to acces invalid mesh index");
 	}
+	return meshes[index];
 }
 
-Mesh* Model::getMesh(size_t index)
+void Model::setModel(glm::mat4 model)
 {
-	if (index >= meshes.size())
+	// node transforms are baked into the vertices on import, so every mesh takes the model transform as it is
+	this->model = model;
+	for (Mesh* mesh : meshes)
 	{
-		throw std::runtime_error("Attemppted to acces invalid mesh index");
+		mesh->setModel(model);
 	}
-	return &meshes[index];
 }
@@ -2,21 +2,21 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include "Mesh.h"
+
+// Meshes loaded from one model file, moved together. The renderer owns the meshes
 class Model
 {
 public:
 	Model();
-	Model(std::vector<Mesh> meshes);
-	~Model();
+	Model(std::vector<Mesh*> meshes);
 
-	size_t getMeshCount() { return meshes.size(); }
+	size_t getMeshCount() const { return meshes.size(); }
 	Mesh* getMesh(size_t index);
-	glm::mat4 getModel() { return model; }
+	glm::mat4 getModel() const { return model; }
 
-	void setModel(glm::mat4 model) { this->model = model; }
+	void setModel(glm::mat4 model);
 
 private:
-	std::vector<Mesh> meshes;
+	std::vector<Mesh*> meshes;
 	glm::mat4 model;
 };
-
@@ -0,0 +1,164 @@
+#include "PipelineCache.h"
+
+#include <filesystem>
+
+PipelineCache::PipelineCache(Device device, const std::string& fileName) : device(device), fileName(fileName)
+{
+	vkGetPhysicalDeviceProperties(device.physical, &deviceProperties);
+
+	std::vector<char> initialData = loadFile();
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheCreateInfo.initialDataSize = initialData.size();
+	cacheCreateInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	VkResult result = vkCreatePipelineCache(device.logical, &cacheCreateInfo, nullptr, &cache);
+	if (result != VK_SUCCESS && !initialData.empty())
+	{
+		// driver refused the data after all, start from an empty cache
+		cacheCreateInfo.initialDataSize = 0;
+		cacheCreateInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device.logical, &cacheCreateInfo, nullptr, &cache);
+	}
+	checkResult(result, "Failed to create a pipeline cache");
+}
+
+PipelineCache::~PipelineCache()
+{
+	for (VkPipelineCache workerCache : workerCaches)
+	{
+		vkDestroyPipelineCache(device.logical, workerCache, nullptr);
+	}
+	vkDestroyPipelineCache(device.logical, cache, nullptr);
+}
+
+VkPipelineCache PipelineCache::createWorkerCache()
+{
+	// the main cache holds what was loaded from disk and merged so far, the lock keeps a merge into it from running meanwhile
+	std::lock_guard<std::mutex> lock(workerMutex);
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(device.logical, cache, &dataSize, nullptr);
+	checkResult(result, "Failed to get pipeline cache size");
+	std::vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(device.logical, cache, &dataSize, data.data());
+	checkResult(result, "Failed to get pipeline cache data");
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheCreateInfo.initialDataSize = dataSize;
+	cacheCreateInfo.pInitialData = dataSize > 0 ? data.data() : nullptr;
+
+	VkPipelineCache workerCache;
+	result = vkCreatePipelineCache(device.logical, &cacheCreateInfo, nullptr, &workerCache);
+	checkResult(result, "Failed to create a worker pipeline cache");
+
+	workerCaches.push_back(workerCache);
+	return workerCache;
+}
+
+void PipelineCache::mergeWorkerCaches()
+{
+	std::lock_guard<std::mutex> lock(workerMutex);
+	if (workerCaches.empty()) return;
+
+	VkResult result = vkMergePipelineCaches(device.logical, cache, static_cast<uint32_t>(workerCaches.size()), workerCaches.data());
+	checkResult(result, "Failed to merge pipeline caches");
+
+	for (VkPipelineCache workerCache : workerCaches)
+	{
+		vkDestroyPipelineCache(device.logical, workerCache, nullptr);
+	}
+	workerCaches.clear();
+}
+
+void PipelineCache::save()
+{
+	mergeWorkerCaches();
+
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(device.logical, cache, &dataSize, nullptr);
+	checkResult(result, "Failed to get pipeline cache size");
+
+	std::vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(device.logical, cache, &dataSize, data.data());
+	checkResult(result, "Failed to get pipeline cache data");
+	data.resize(dataSize);
+
+	PipelineCacheFileHeader header = makeHeader(data);
+
+	std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open pipeline cache file for writing! (" + tempFileName + ")");
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		file.flush();
+		if (!file.good())
+		{
+			throw std::runtime_error("Failed to write pipeline cache file! (" + tempFileName + ")");
+		}
+	}
+
+	// rename replaces the old file in one step
+	std::filesystem::rename(tempFileName, fileName);
+}
+
+std::vector<char> PipelineCache::loadFile()
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) return {};
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(PipelineCacheFileHeader))
+	{
+		printf("Pipeline cache: %s is too small, ignoring it\n", fileName.c_str());
+		return {};
+	}
+	file.seekg(0);
+
+	PipelineCacheFileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (header.dataSize != fileSize - sizeof(header))
+	{
+		printf("Pipeline cache: %s is truncated, ignoring it\n", fileName.c_str());
+		return {};
+	}
+
+	std::vector<char> data(static_cast<size_t>(header.dataSize));
+	file.read(data.data(), data.size());
+
+	// a cache from another GPU or driver is useless at best, drivers have crashed on it at worst
+	PipelineCacheFileHeader expected = makeHeader(data);
+	if (header.magic != expected.magic || header.version != expected.version ||
+		header.vendorID != expected.vendorID || header.deviceID != expected.deviceID || header.driverVersion != expected.driverVersion ||
+		memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		printf("Pipeline cache: %s was written for another device or driver, ignoring it\n", fileName.c_str());
+		return {};
+	}
+	if (header.dataHash != expected.dataHash)
+	{
+		printf("Pipeline cache: %s is corrupted, ignoring it\n", fileName.c_str());
+		return {};
+	}
+
+	return data;
+}
+
+PipelineCacheFileHeader PipelineCache::makeHeader(const std::vector<char>& data) const
+{
+	PipelineCacheFileHeader header = {};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = deviceProperties.vendorID;
+	header.deviceID = deviceProperties.deviceID;
+	header.driverVersion = deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = hashFnv1a(data.data(), data.size());
+	return header;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// File layout: header followed by the raw vkGetPipelineCacheData blob
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;									// PIPELINE_CACHE_MAGIC
+	uint32_t version;								// PIPELINE_CACHE_VERSION
+	uint32_t vendorID;								// cache data is only valid for the exact same device and driver
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;								// size of the blob after the header
+	uint64_t dataHash;								// FNV-1a of the blob, catches truncated or damaged files
+};
+
+const uint32_t PIPELINE_CACHE_MAGIC = 0x43504b56;	// "VKPC"
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// VkPipelineCache persisted to disk between runs
+// Worker threads build into their own caches so they don't contend on one, which get merged back into the main one
+// (only the destination of vkMergePipelineCaches needs external synchronisation)
+class PipelineCache
+{
+public:
+	PipelineCache(Device device, const std::string& fileName);
+	~PipelineCache();
+
+	VkPipelineCache getCache() const { return cache; }
+
+	// Cache for one worker thread seeded with the contents of the main cache, owned by PipelineCache until mergeWorkerCaches
+	VkPipelineCache createWorkerCache();
+	// Merges every worker cache into the main cache and destroys them. Not thread safe with pipeline creation on the main cache
+	void mergeWorkerCaches();
+
+	// Writes to a temporary file first and renames it over the old one, a crash mid-save leaves the previous cache intact
+	void save();
+
+private:
+	Device device;
+	std::string fileName;
+	VkPhysicalDeviceProperties deviceProperties;
+
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::vector<VkPipelineCache> workerCaches;
+	std::mutex workerMutex;
+
+	std::vector<char> loadFile();
+	PipelineCacheFileHeader makeHeader(const std::vector<char>& data) const;
+};
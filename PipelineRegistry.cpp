@@ -0,0 +1,190 @@
+#include "PipelineRegistry.h"
+
+#include <cstring>
+
+// Hashes create info structs field by field, they hold pointers and padding that must not end up in the hash
+// Structs passed to addArray are plain 32/64 bit fields without padding
+struct StateHasher
+{
+	uint64_t hash = FNV1A_OFFSET_BASIS;
+
+	template<typename T>
+	void add(const T& value)
+	{
+		hash = hashFnv1a(&value, sizeof(T), hash);
+	}
+
+	template<typename T>
+	void addArray(const T* values, uint32_t count)
+	{
+		if (values == nullptr) count = 0;
+		add(count);
+		hash = hashFnv1a(values, sizeof(T) * count, hash);
+	}
+};
+
+PipelineRegistry::PipelineRegistry(Device device) : device(device)
+{
+}
+
+PipelineRegistry::~PipelineRegistry()
+{
+	for (const auto& entry : pipelines)
+	{
+		vkDestroyPipeline(device.logical, entry.second, nullptr);
+	}
+}
+
+uint64_t PipelineRegistry::hashState(const VkGraphicsPipelineCreateInfo& pipelineInfo)
+{
+	StateHasher hasher;
+	hasher.add(pipelineInfo.flags);
+
+	// -- SHADER STAGES --
+	hasher.add(pipelineInfo.stageCount);
+	for (uint32_t i = 0; i < pipelineInfo.stageCount; i++)
+	{
+		const VkPipelineShaderStageCreateInfo& stage = pipelineInfo.pStages[i];
+		hasher.add(stage.stage);
+		hasher.add(stage.module);
+		hasher.addArray(stage.pName, static_cast<uint32_t>(strlen(stage.pName)));
+
+		const VkSpecializationInfo* specialization = stage.pSpecializationInfo;
+		hasher.add(specialization != nullptr);
+		if (specialization != nullptr)
+		{
+			hasher.addArray(specialization->pMapEntries, specialization->mapEntryCount);
+			hasher.addArray(static_cast<const uint8_t*>(specialization->pData), static_cast<uint32_t>(specialization->dataSize));
+		}
+	}
+
+	// -- VERTEX INPUT --
+	if (const VkPipelineVertexInputStateCreateInfo* vertexInput = pipelineInfo.pVertexInputState)
+	{
+		hasher.addArray(vertexInput->pVertexBindingDescriptions, vertexInput->vertexBindingDescriptionCount);
+		hasher.addArray(vertexInput->pVertexAttributeDescriptions, vertexInput->vertexAttributeDescriptionCount);
+	}
+
+	// -- INPUT ASSEMBLY --
+	if (const VkPipelineInputAssemblyStateCreateInfo* inputAssembly = pipelineInfo.pInputAssemblyState)
+	{
+		hasher.add(inputAssembly->topology);
+		hasher.add(inputAssembly->primitiveRestartEnable);
+	}
+
+	if (const VkPipelineTessellationStateCreateInfo* tessellation = pipelineInfo.pTessellationState)
+	{
+		hasher.add(tessellation->patchControlPoints);
+	}
+
+	// -- VIEWPORT --
+	if (const VkPipelineViewportStateCreateInfo* viewport = pipelineInfo.pViewportState)
+	{
+		hasher.add(viewport->viewportCount);
+		hasher.add(viewport->scissorCount);
+		hasher.addArray(viewport->pViewports, viewport->viewportCount);		// ignored when dynamic, still hashed
+		hasher.addArray(viewport->pScissors, viewport->scissorCount);
+	}
+
+	// -- RASTERIZER --
+	if (const VkPipelineRasterizationStateCreateInfo* rasterizer = pipelineInfo.pRasterizationState)
+	{
+		hasher.add(rasterizer->depthClampEnable);
+		hasher.add(rasterizer->rasterizerDiscardEnable);
+		hasher.add(rasterizer->polygonMode);
+		hasher.add(rasterizer->cullMode);
+		hasher.add(rasterizer->frontFace);
+		hasher.add(rasterizer->depthBiasEnable);
+		hasher.add(rasterizer->depthBiasConstantFactor);
+		hasher.add(rasterizer->depthBiasClamp);
+		hasher.add(rasterizer->depthBiasSlopeFactor);
+		hasher.add(rasterizer->lineWidth);
+	}
+
+	// -- MULTISAMPLING --
+	if (const VkPipelineMultisampleStateCreateInfo* multisampling = pipelineInfo.pMultisampleState)
+	{
+		hasher.add(multisampling->rasterizationSamples);
+		hasher.add(multisampling->sampleShadingEnable);
+		hasher.add(multisampling->minSampleShading);
+		hasher.addArray(multisampling->pSampleMask, (multisampling->rasterizationSamples + 31) / 32);
+		hasher.add(multisampling->alphaToCoverageEnable);
+		hasher.add(multisampling->alphaToOneEnable);
+	}
+
+	// -- DEPTH STENCIL --
+	if (const VkPipelineDepthStencilStateCreateInfo* depthStencil = pipelineInfo.pDepthStencilState)
+	{
+		hasher.add(depthStencil->depthTestEnable);
+		hasher.add(depthStencil->depthWriteEnable);
+		hasher.add(depthStencil->depthCompareOp);
+		hasher.add(depthStencil->depthBoundsTestEnable);
+		hasher.add(depthStencil->stencilTestEnable);
+		hasher.add(depthStencil->front);
+		hasher.add(depthStencil->back);
+		hasher.add(depthStencil->minDepthBounds);
+		hasher.add(depthStencil->maxDepthBounds);
+	}
+
+	// -- BLENDING --
+	if (const VkPipelineColorBlendStateCreateInfo* colorBlend = pipelineInfo.pColorBlendState)
+	{
+		hasher.add(colorBlend->logicOpEnable);
+		hasher.add(colorBlend->logicOp);
+		hasher.addArray(colorBlend->pAttachments, colorBlend->attachmentCount);
+		hasher.add(colorBlend->blendConstants);
+	}
+
+	if (const VkPipelineDynamicStateCreateInfo* dynamicState = pipelineInfo.pDynamicState)
+	{
+		hasher.addArray(dynamicState->pDynamicStates, dynamicState->dynamicStateCount);
+	}
+
+	hasher.add(pipelineInfo.layout);
+	hasher.add(pipelineInfo.renderPass);
+	hasher.add(pipelineInfo.subpass);
+	return hasher.hash;
+}
+
+VkPipeline PipelineRegistry::find(uint64_t stateHash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	requestCount++;
+
+	auto found = pipelines.find(stateHash);
+	if (found == pipelines.end()) return VK_NULL_HANDLE;
+
+	hitCount++;
+	return found->second;
+}
+
+VkPipeline PipelineRegistry::insert(uint64_t stateHash, VkPipeline pipeline)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto inserted = pipelines.insert({ stateHash, pipeline });
+	if (!inserted.second)
+	{
+		// lost the race, keep the handle others may already use
+		vkDestroyPipeline(device.logical, pipeline, nullptr);
+	}
+	return inserted.first->second;
+}
+
+void PipelineRegistry::remove(VkPipeline pipeline)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto entry = pipelines.begin(); entry != pipelines.end(); ++entry)
+	{
+		if (entry->second == pipeline)
+		{
+			pipelines.erase(entry);
+			return;
+		}
+	}
+}
+
+size_t PipelineRegistry::getPipelineCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pipelines.size();
+}
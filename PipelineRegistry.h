@@ -0,0 +1,45 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+#include "Utilities.h"
+
+// Every graphics pipeline by a hash of its complete create info: shader stages and specialization data, all fixed function state,
+// layout, render pass and subpass. Equivalent requests get the same VkPipeline. Owns the pipelines it holds
+// Only the 64 bit hash is compared, a collision would need billions of distinct pipelines to become likely
+class PipelineRegistry
+{
+public:
+	PipelineRegistry(Device device);
+	~PipelineRegistry();
+
+	// Handles of shader modules, layouts and render passes are part of the state, not their contents
+	static uint64_t hashState(const VkGraphicsPipelineCreateInfo& pipelineInfo);
+
+	// VK_NULL_HANDLE when the state has not been built yet, counted as a request either way
+	VkPipeline find(uint64_t stateHash);
+	// Takes ownership. If another thread registered the same state meanwhile, the new pipeline is destroyed and the existing one returned
+	VkPipeline insert(uint64_t stateHash, VkPipeline pipeline);
+	// Hands ownership back to the caller, e.g. to destroy it once no frame uses it anymore
+	void remove(VkPipeline pipeline);
+
+#pragma region getters
+	size_t getPipelineCount();
+	size_t getRequestCount() const { return requestCount; }
+	size_t getHitCount() const { return hitCount; }
+	double getHitRate() const { return requestCount > 0 ? double(hitCount) / double(requestCount) : 0.0; }
+#pragma endregion
+
+private:
+	Device device;
+	std::unordered_map<uint64_t, VkPipeline> pipelines;
+	std::mutex mutex;
+
+	std::atomic<size_t> requestCount{ 0 };
+	std::atomic<size_t> hitCount{ 0 };
+};
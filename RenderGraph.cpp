@@ -0,0 +1,530 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+// Every access flag that writes memory, anything else in a mask only reads
+static const VkAccessFlags WRITE_ACCESS_MASK =
+	VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+static bool hasStencilComponent(VkFormat format)
+{
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+		format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_S8_UINT;
+}
+
+RenderGraph::RenderGraph(Device device) : device(device)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (const Resource& resource : resources)
+	{
+		if (resource.imported) continue;
+		if (resource.imageView != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(device.logical, resource.imageView, nullptr);
+		}
+		if (resource.image != VK_NULL_HANDLE)
+		{
+			vkDestroyImage(device.logical, resource.image, nullptr);
+		}
+	}
+	for (const MemoryBlock& block : memoryBlocks)
+	{
+		vkFreeMemory(device.logical, block.memory, nullptr);
+	}
+}
+
+size_t RenderGraph::createImage(const std::string& name, const ImageDesc& desc)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resource.barrierAspect = hasStencilComponent(desc.format) ? desc.aspect | VK_IMAGE_ASPECT_STENCIL_BIT : desc.aspect;
+
+	resources.push_back(resource);
+	return resources.size() - 1;
+}
+
+size_t RenderGraph::importImage(const std::string& name, VkFormat format, VkImageAspectFlags aspect,
+	VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags firstStage)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = {};
+	resource.desc.format = format;
+	resource.desc.aspect = aspect;
+	resource.imported = true;
+	resource.initialLayout = initialLayout;
+	resource.finalLayout = finalLayout;
+	resource.firstStage = firstStage;
+	resource.barrierAspect = hasStencilComponent(format) ? aspect | VK_IMAGE_ASPECT_STENCIL_BIT : aspect;
+
+	resources.push_back(resource);
+	return resources.size() - 1;
+}
+
+void RenderGraph::setImportedImage(size_t resource, VkImage image, VkImageView imageView)
+{
+	if (!resources[resource].imported)
+	{
+		throw std::runtime_error("Render graph image " + resources[resource].name + " is not imported!");
+	}
+	resources[resource].image = image;
+	resources[resource].imageView = imageView;
+}
+
+size_t RenderGraph::addPass(const std::string& name, const std::vector<RenderGraphAccess>& reads, const std::vector<RenderGraphAccess>& writes, RenderGraphExecute execute)
+{
+	for (const RenderGraphAccess& write : writes)
+	{
+		if (write.usage == ResourceUsage::InputAttachment || write.usage == ResourceUsage::ShaderRead || write.usage == ResourceUsage::TransferSrc)
+		{
+			throw std::runtime_error("Render graph pass " + name + " writes " + resources[write.resource].name + " with a read only usage!");
+		}
+		// one state per image per pass, read-modify-write attachments are declared as writes
+		for (const RenderGraphAccess& read : reads)
+		{
+			if (read.resource == write.resource)
+			{
+				throw std::runtime_error("Render graph pass " + name + " reads and writes " + resources[write.resource].name + "!");
+			}
+		}
+	}
+	for (const RenderGraphAccess& read : reads)
+	{
+		if (read.usage == ResourceUsage::TransferDst)
+		{
+			throw std::runtime_error("Render graph pass " + name + " reads " + resources[read.resource].name + " with a write only usage!");
+		}
+	}
+
+	Pass pass;
+	pass.name = name;
+	pass.reads = reads;
+	pass.writes = writes;
+	pass.execute = execute;
+
+	passes.push_back(pass);
+	return passes.size() - 1;
+}
+
+void RenderGraph::compile()
+{
+	if (compiled) return;
+
+	cullPasses();
+	computeLifetimes();
+	allocateTransientImages();
+	computeBarriers();
+
+	compiled = true;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+	for (size_t passIndex : passOrder)
+	{
+		recordBarriers(cmdBuffer, passes[passIndex].barriers);
+		passes[passIndex].execute(cmdBuffer, imageIndex);
+	}
+	recordBarriers(cmdBuffer, finalBarriers);
+}
+
+void RenderGraph::cullPasses()
+{
+	// imported images leave the frame, everything else only matters if a kept pass reads it
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		needed[i] = resources[i].imported;
+	}
+
+	// walk backwards so a pass knows whether anything after it consumes its writes
+	// passes without writes work outside the graph (e.g. buffers) and are always kept
+	for (size_t i = passes.size(); i-- > 0;)
+	{
+		Pass& pass = passes[i];
+		bool contributes = pass.writes.empty();
+		for (const RenderGraphAccess& write : pass.writes)
+		{
+			contributes = contributes || needed[write.resource];
+		}
+
+		pass.culled = !contributes;
+		if (pass.culled) continue;
+
+		for (const RenderGraphAccess& read : pass.reads)
+		{
+			needed[read.resource] = true;
+		}
+	}
+
+	passOrder.clear();
+	culledPassCount = 0;
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		if (passes[i].culled)
+		{
+			culledPassCount++;
+			continue;
+		}
+		passOrder.push_back(i);
+	}
+}
+
+void RenderGraph::computeLifetimes()
+{
+	for (size_t order = 0; order < passOrder.size(); order++)
+	{
+		const Pass& pass = passes[passOrder[order]];
+		auto extend = [this, order](const RenderGraphAccess& access)
+		{
+			Resource& resource = resources[access.resource];
+			if (resource.firstPass < 0)
+			{
+				resource.firstPass = static_cast<int>(order);
+			}
+			resource.lastPass = static_cast<int>(order);
+		};
+		std::for_each(pass.reads.begin(), pass.reads.end(), extend);
+		std::for_each(pass.writes.begin(), pass.writes.end(), extend);
+	}
+}
+
+void RenderGraph::allocateTransientImages()
+{
+	std::vector<size_t> transients;
+	std::vector<VkMemoryRequirements> memRequirements(resources.size());
+
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		Resource& resource = resources[i];
+		if (resource.imported || resource.firstPass < 0) continue;		// unused images are never created
+
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.extent.width = resource.desc.extent.width;
+		imageCreateInfo.extent.height = resource.desc.extent.height;
+		imageCreateInfo.extent.depth = 1;
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.format = resource.desc.format;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.usage = resource.desc.usage;
+		imageCreateInfo.samples = resource.desc.samples;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkResult result = vkCreateImage(device.logical, &imageCreateInfo, nullptr, &resource.image);
+		checkResult(result, "Failed to create a render graph image");
+
+		vkGetImageMemoryRequirements(device.logical, resource.image, &memRequirements[i]);
+		unaliasedMemorySize += memRequirements[i].size;
+		transients.push_back(i);
+	}
+
+	// largest first, so smaller images land in blocks that are already big enough
+	std::sort(transients.begin(), transients.end(), [&memRequirements](size_t a, size_t b)
+	{
+		return memRequirements[a].size > memRequirements[b].size;
+	});
+
+	// images whose lifetimes don't overlap share a block, each image binds at offset 0
+	for (size_t index : transients)
+	{
+		Resource& resource = resources[index];
+		bool lazy = (resource.desc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+		size_t blockIndex = memoryBlocks.size();
+		for (size_t b = 0; b < memoryBlocks.size() && blockIndex == memoryBlocks.size(); b++)
+		{
+			const MemoryBlock& block = memoryBlocks[b];
+			if ((block.memoryTypeBits & memRequirements[index].memoryTypeBits) == 0 || block.lazy != lazy) continue;
+
+			bool overlaps = false;
+			for (size_t other : block.resources)
+			{
+				overlaps = overlaps || !(resources[other].lastPass < resource.firstPass || resource.lastPass < resources[other].firstPass);
+			}
+			if (!overlaps)
+			{
+				blockIndex = b;
+			}
+		}
+		if (blockIndex == memoryBlocks.size())
+		{
+			memoryBlocks.push_back(MemoryBlock());
+			memoryBlocks.back().lazy = lazy;
+		}
+
+		MemoryBlock& block = memoryBlocks[blockIndex];
+		block.size = std::max(block.size, memRequirements[index].size);
+		block.memoryTypeBits &= memRequirements[index].memoryTypeBits;
+		block.resources.push_back(index);
+		resource.memoryBlock = blockIndex;
+	}
+
+	transientMemorySize = 0;
+	lazyMemorySize = 0;
+	for (MemoryBlock& block : memoryBlocks)
+	{
+		// tile based GPUs expose lazily allocated memory, attachments that never leave tile memory then cost no physical memory
+		uint32_t memoryType;
+		bool lazy = block.lazy && findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &memoryType);
+		if (!lazy && !findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryType))
+		{
+			throw std::runtime_error("No device local memory type for render graph images!");
+		}
+
+		VkMemoryAllocateInfo memAllocInfo = {};
+		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAllocInfo.allocationSize = block.size;
+		memAllocInfo.memoryTypeIndex = memoryType;
+
+		VkResult result = vkAllocateMemory(device.logical, &memAllocInfo, nullptr, &block.memory);
+		checkResult(result, "Failed to allocate render graph memory");
+		transientMemorySize += block.size;
+		if (lazy) lazyMemorySize += block.size;
+
+		for (size_t index : block.resources)
+		{
+			Resource& resource = resources[index];
+			vkBindImageMemory(device.logical, resource.image, block.memory, 0);
+
+			VkImageViewCreateInfo viewCreateInfo = {};
+			viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCreateInfo.image = resource.image;
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCreateInfo.format = resource.desc.format;
+			viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewCreateInfo.subresourceRange.aspectMask = resource.desc.aspect;
+			viewCreateInfo.subresourceRange.baseMipLevel = 0;
+			viewCreateInfo.subresourceRange.levelCount = 1;
+			viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+			viewCreateInfo.subresourceRange.layerCount = 1;
+
+			result = vkCreateImageView(device.logical, &viewCreateInfo, nullptr, &resource.imageView);
+			checkResult(result, "Failed to create a render graph image view");
+		}
+	}
+}
+
+void RenderGraph::computeBarriers()
+{
+	// what the GPU may still be doing to an image when the next pass touches it
+	struct SyncState
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStage;			// last write or layout transition
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages;			// reads since the last write, a new write has to wait for them
+		VkPipelineStageFlags visibleStages;			// stages that already waited on the last write
+	};
+
+	std::vector<SyncState> states(resources.size());
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+		SyncState& state = states[i];
+		state = { resource.initialLayout, resource.firstStage, 0, 0, 0 };
+		if (resource.imported || resource.firstPass < 0) continue;
+
+		// transient contents are discarded, but the first use still has to wait for the previous frame
+		// and for every image that aliased the same memory before it
+		state.writeStage = 0;
+		for (size_t other : memoryBlocks[resource.memoryBlock].resources)
+		{
+			for (size_t passIndex : passOrder)
+			{
+				const Pass& pass = passes[passIndex];
+				for (const RenderGraphAccess& access : pass.reads)
+				{
+					if (access.resource == other) state.writeStage |= getUsageState(access.usage, false).stage;
+				}
+				for (const RenderGraphAccess& access : pass.writes)
+				{
+					if (access.resource != other) continue;
+					ImageState usageState = getUsageState(access.usage, true);
+					state.writeStage |= usageState.stage;
+					state.writeAccess |= usageState.access & WRITE_ACCESS_MASK;
+				}
+			}
+		}
+	}
+
+	for (size_t passIndex : passOrder)
+	{
+		Pass& pass = passes[passIndex];
+		pass.barriers.clear();
+
+		for (const RenderGraphAccess& read : pass.reads)
+		{
+			SyncState& state = states[read.resource];
+			ImageState target = getUsageState(read.usage, false);
+			bool transition = state.layout != target.layout;
+			bool unsynced = state.writeStage != 0 && (state.visibleStages & target.stage) != target.stage;
+
+			if (!transition && !unsynced)
+			{
+				state.readStages |= target.stage;
+				continue;
+			}
+
+			Barrier barrier = {};
+			barrier.resource = read.resource;
+			barrier.oldLayout = state.layout;
+			barrier.newLayout = target.layout;
+			barrier.srcStage = transition ? state.writeStage | state.readStages : state.writeStage;
+			barrier.srcAccess = state.writeAccess;
+			barrier.dstStage = target.stage;
+			barrier.dstAccess = target.access;
+			pass.barriers.push_back(barrier);
+
+			if (transition)
+			{
+				// the transition itself is a write that later readers in other stages have to wait on
+				state = { target.layout, target.stage, 0, target.stage, target.stage };
+			}
+			else
+			{
+				state.readStages |= target.stage;
+				state.visibleStages |= target.stage;
+			}
+		}
+
+		for (const RenderGraphAccess& write : pass.writes)
+		{
+			SyncState& state = states[write.resource];
+			ImageState target = getUsageState(write.usage, true);
+
+			Barrier barrier = {};
+			barrier.resource = write.resource;
+			barrier.oldLayout = state.layout;
+			barrier.newLayout = target.layout;
+			barrier.srcStage = state.writeStage | state.readStages;
+			barrier.srcAccess = state.writeAccess;
+			barrier.dstStage = target.stage;
+			barrier.dstAccess = target.access;
+			pass.barriers.push_back(barrier);
+
+			state = { target.layout, target.stage, target.access & WRITE_ACCESS_MASK, 0, 0 };
+		}
+	}
+
+	finalBarriers.clear();
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+		const SyncState& state = states[i];
+		if (!resource.imported || resource.firstPass < 0 || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+		if (state.layout == resource.finalLayout) continue;
+
+		// whatever consumes the image next (present, another submit) waits on a semaphore, which covers the rest
+		Barrier barrier = {};
+		barrier.resource = i;
+		barrier.oldLayout = state.layout;
+		barrier.newLayout = resource.finalLayout;
+		barrier.srcStage = state.writeStage | state.readStages;
+		barrier.srcAccess = state.writeAccess;
+		barrier.dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		barrier.dstAccess = 0;
+		finalBarriers.push_back(barrier);
+	}
+}
+
+bool RenderGraph::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties, uint32_t* memoryType) const
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(device.physical, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if ((memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			*memoryType = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+RenderGraph::ImageState RenderGraph::getUsageState(ResourceUsage usage, bool write)
+{
+	switch (usage)
+	{
+	case ResourceUsage::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			write ? VkAccessFlags(VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT) : VkAccessFlags(VK_ACCESS_COLOR_ATTACHMENT_READ_BIT) };
+	case ResourceUsage::DepthAttachment:
+		return { write ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			write ? VkAccessFlags(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) : VkAccessFlags(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT) };
+	case ResourceUsage::InputAttachment:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT };
+	case ResourceUsage::ShaderRead:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+	case ResourceUsage::Storage:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			write ? VkAccessFlags(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT) : VkAccessFlags(VK_ACCESS_SHADER_READ_BIT) };
+	case ResourceUsage::TransferSrc:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+	case ResourceUsage::TransferDst:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+	}
+	throw std::runtime_error("Unknown render graph resource usage!");
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer cmdBuffer, const std::vector<Barrier>& barriers)
+{
+	if (barriers.empty()) return;
+
+	// one vkCmdPipelineBarrier per pass, stage masks are merged
+	std::vector<VkImageMemoryBarrier> imageBarriers(barriers.size());
+	VkPipelineStageFlags srcStage = 0;
+	VkPipelineStageFlags dstStage = 0;
+
+	for (size_t i = 0; i < barriers.size(); i++)
+	{
+		const Barrier& barrier = barriers[i];
+		const Resource& resource = resources[barrier.resource];
+		if (resource.image == VK_NULL_HANDLE)
+		{
+			throw std::runtime_error("Render graph image " + resource.name + " has no image bound!");
+		}
+
+		VkImageMemoryBarrier& imgMemBarrier = imageBarriers[i];
+		imgMemBarrier = {};
+		imgMemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imgMemBarrier.oldLayout = barrier.oldLayout;
+		imgMemBarrier.newLayout = barrier.newLayout;
+		imgMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imgMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imgMemBarrier.image = resource.image;
+		imgMemBarrier.subresourceRange.aspectMask = resource.barrierAspect;
+		imgMemBarrier.subresourceRange.baseMipLevel = 0;
+		imgMemBarrier.subresourceRange.levelCount = 1;
+		imgMemBarrier.subresourceRange.baseArrayLayer = 0;
+		imgMemBarrier.subresourceRange.layerCount = 1;
+		imgMemBarrier.srcAccessMask = barrier.srcAccess;
+		imgMemBarrier.dstAccessMask = barrier.dstAccess;
+
+		srcStage |= barrier.srcStage;
+		dstStage |= barrier.dstStage;
+	}
+
+	vkCmdPipelineBarrier
+	(
+		cmdBuffer,
+		srcStage != 0 ? srcStage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+		0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data()
+	);
+}
@@ -0,0 +1,151 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// How a pass touches an image, every usage maps to one layout + pipeline stage + access combination
+enum class ResourceUsage
+{
+	ColorAttachment,
+	DepthAttachment,		// as a read: read only depth (DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+	InputAttachment,
+	ShaderRead,				// sampled in fragment or compute shaders
+	Storage,				// storage image in GENERAL layout
+	TransferSrc,
+	TransferDst
+};
+
+struct ImageDesc
+{
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspect;												// aspect of the image view
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+struct RenderGraphAccess
+{
+	size_t resource;
+	ResourceUsage usage;
+};
+
+using RenderGraphExecute = std::function<void(VkCommandBuffer cmdBuffer, uint32_t imageIndex)>;
+
+// Passes are added in execution order and declare the images they read and write
+// compile() culls passes that don't contribute to an output, computes the barriers between passes
+// and creates the transient images, sharing memory between images whose lifetimes don't overlap
+class RenderGraph
+{
+public:
+	RenderGraph(Device device);
+	~RenderGraph();
+
+	// Transient image owned by the graph, contents don't survive the frame
+	// With VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT in the usage it gets lazily allocated memory where the device has it
+	size_t createImage(const std::string& name, const ImageDesc& desc);
+	// External image (e.g. swapchain), bound every frame with setImportedImage. Always counts as a graph output
+	// firstStage is the stage the image becomes available at (the semaphore wait stage for swapchain images)
+	size_t importImage(const std::string& name, VkFormat format, VkImageAspectFlags aspect,
+		VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags firstStage);
+	void setImportedImage(size_t resource, VkImage image, VkImageView imageView);
+
+	size_t addPass(const std::string& name, const std::vector<RenderGraphAccess>& reads, const std::vector<RenderGraphAccess>& writes, RenderGraphExecute execute);
+
+	void compile();
+	void execute(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+
+#pragma region getters
+	VkImage getImage(size_t resource)				const { return resources[resource].image; }
+	VkImageView getImageView(size_t resource)		const { return resources[resource].imageView; }
+	size_t getCulledPassCount()						const { return culledPassCount; }
+	VkDeviceSize getTransientMemorySize()			const { return transientMemorySize; }		// after aliasing
+	VkDeviceSize getUnaliasedMemorySize()			const { return unaliasedMemorySize; }		// what separate allocations would cost
+	VkDeviceSize getLazyMemorySize()				const { return lazyMemorySize; }			// part of the transient size that may never be committed
+#pragma endregion
+
+private:
+	struct ImageState
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags stage;
+		VkAccessFlags access;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		ImageDesc desc;
+		bool imported = false;
+		VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags firstStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		VkImageAspectFlags barrierAspect = 0;								// layout transitions must cover depth AND stencil
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+
+		int firstPass = -1;													// lifetime in compiled pass order
+		int lastPass = -1;
+		size_t memoryBlock = 0;
+	};
+
+	struct Barrier
+	{
+		size_t resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkPipelineStageFlags srcStage;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::vector<RenderGraphAccess> reads;
+		std::vector<RenderGraphAccess> writes;
+		RenderGraphExecute execute;
+		bool culled = false;
+		std::vector<Barrier> barriers;										// issued right before the pass
+	};
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeBits = ~0u;
+		bool lazy = false;													// transient attachments only, they alias each other but never other images
+		std::vector<size_t> resources;										// resources aliasing this block, lifetimes never overlap
+	};
+
+	Device device;
+	bool compiled = false;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<size_t> passOrder;											// alive passes in execution order
+	std::vector<Barrier> finalBarriers;										// imported images to their final layout
+	std::vector<MemoryBlock> memoryBlocks;
+
+	size_t culledPassCount = 0;
+	VkDeviceSize transientMemorySize = 0;
+	VkDeviceSize unaliasedMemorySize = 0;
+	VkDeviceSize lazyMemorySize = 0;
+
+	void cullPasses();
+	void computeLifetimes();
+	void computeBarriers();
+	void allocateTransientImages();
+	bool findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties, uint32_t* memoryType) const;
+
+	static ImageState getUsageState(ResourceUsage usage, bool write);
+	void recordBarriers(VkCommandBuffer cmdBuffer, const std::vector<Barrier>& barriers);
+};
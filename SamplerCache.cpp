@@ -0,0 +1,115 @@
+#include "SamplerCache.h"
+
+SamplerCache::SamplerCache(Device device) : device(device)
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(device.physical, &deviceProperties);
+	maxAnisotropy = deviceProperties.limits.maxSamplerAnisotropy;
+	maxSamplerCount = deviceProperties.limits.maxSamplerAllocationCount;
+}
+
+SamplerCache::~SamplerCache()
+{
+	for (const auto& entry : samplers)
+	{
+		vkDestroySampler(device.logical, entry.second.sampler, nullptr);
+	}
+}
+
+VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& samplerInfo)
+{
+	if (samplerInfo.pNext != nullptr)
+	{
+		throw std::runtime_error("Sampler create info chains are not supported by the sampler cache!");
+	}
+
+	// requests above the limit would otherwise get samplers that behave the same but hash differently
+	VkSamplerCreateInfo clamped = samplerInfo;
+	clamped.maxAnisotropy = clamped.anisotropyEnable ? std::min(clamped.maxAnisotropy, maxAnisotropy) : 1.0f;
+	uint64_t hash = hashState(clamped);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = samplers.equal_range(hash);
+	for (auto entry = range.first; entry != range.second; ++entry)
+	{
+		if (equalState(entry->second.samplerInfo, clamped))
+		{
+			reuseCount++;
+			return entry->second.sampler;
+		}
+	}
+
+	if (samplers.size() >= maxSamplerCount)
+	{
+		throw std::runtime_error("Sampler cache reached maxSamplerAllocationCount!");
+	}
+
+	VkSampler sampler;
+	VkResult result = vkCreateSampler(device.logical, &clamped, nullptr, &sampler);
+	checkResult(result, "Failed to create a texture sampler");
+
+	samplers.insert({ hash, { clamped, sampler } });
+	return sampler;
+}
+
+VkSampler SamplerCache::getSampler(const SamplerState& state)
+{
+	return getSampler(describe(state));
+}
+
+VkSamplerCreateInfo SamplerCache::describe(const SamplerState& state)
+{
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = state.filter;
+	samplerInfo.minFilter = state.filter;
+	samplerInfo.addressModeU = state.addressMode;
+	samplerInfo.addressModeV = state.addressMode;
+	samplerInfo.addressModeW = state.addressMode;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.mipmapMode = state.mipmapMode;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;						// each view limits it to its own mip chain
+	samplerInfo.anisotropyEnable = state.maxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+	samplerInfo.maxAnisotropy = state.maxAnisotropy;
+	return samplerInfo;
+}
+
+size_t SamplerCache::getSamplerCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return samplers.size();
+}
+
+uint64_t SamplerCache::hashState(const VkSamplerCreateInfo& samplerInfo)
+{
+	// field by field, the struct has padding and a pointer
+	uint64_t hash = hashFnv1a(&samplerInfo.flags, sizeof(samplerInfo.flags));
+	hash = hashFnv1a(&samplerInfo.magFilter, sizeof(samplerInfo.magFilter), hash);
+	hash = hashFnv1a(&samplerInfo.minFilter, sizeof(samplerInfo.minFilter), hash);
+	hash = hashFnv1a(&samplerInfo.mipmapMode, sizeof(samplerInfo.mipmapMode), hash);
+	hash = hashFnv1a(&samplerInfo.addressModeU, sizeof(samplerInfo.addressModeU), hash);
+	hash = hashFnv1a(&samplerInfo.addressModeV, sizeof(samplerInfo.addressModeV), hash);
+	hash = hashFnv1a(&samplerInfo.addressModeW, sizeof(samplerInfo.addressModeW), hash);
+	hash = hashFnv1a(&samplerInfo.mipLodBias, sizeof(samplerInfo.mipLodBias), hash);
+	hash = hashFnv1a(&samplerInfo.anisotropyEnable, sizeof(samplerInfo.anisotropyEnable), hash);
+	hash = hashFnv1a(&samplerInfo.maxAnisotropy, sizeof(samplerInfo.maxAnisotropy), hash);
+	hash = hashFnv1a(&samplerInfo.compareEnable, sizeof(samplerInfo.compareEnable), hash);
+	hash = hashFnv1a(&samplerInfo.compareOp, sizeof(samplerInfo.compareOp), hash);
+	hash = hashFnv1a(&samplerInfo.minLod, sizeof(samplerInfo.minLod), hash);
+	hash = hashFnv1a(&samplerInfo.maxLod, sizeof(samplerInfo.maxLod), hash);
+	hash = hashFnv1a(&samplerInfo.borderColor, sizeof(samplerInfo.borderColor), hash);
+	hash = hashFnv1a(&samplerInfo.unnormalizedCoordinates, sizeof(samplerInfo.unnormalizedCoordinates), hash);
+	return hash;
+}
+
+bool SamplerCache::equalState(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b)
+{
+	return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+		a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW &&
+		a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy &&
+		a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod &&
+		a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Owns every sampler, keyed by the complete create info. Equal descriptions share one VkSampler, so per texture sampler state
+// stays far below maxSamplerAllocationCount
+class SamplerCache
+{
+public:
+	SamplerCache(Device device);
+	~SamplerCache();
+
+	// Anisotropy is clamped to the device limit first, pNext chains are not supported
+	VkSampler getSampler(const VkSamplerCreateInfo& samplerInfo);
+	VkSampler getSampler(const SamplerState& state);
+
+	static VkSamplerCreateInfo describe(const SamplerState& state);
+
+#pragma region getters
+	size_t getSamplerCount();
+	size_t getReuseCount() const { return reuseCount; }			// requests answered with an existing sampler
+#pragma endregion
+
+private:
+	struct SamplerEntry
+	{
+		VkSamplerCreateInfo samplerInfo;
+		VkSampler sampler;
+	};
+
+	Device device;
+	float maxAnisotropy;
+	uint32_t maxSamplerCount;
+	std::unordered_multimap<uint64_t, SamplerEntry> samplers;		// by hash of the create info
+	size_t reuseCount = 0;
+	std::mutex mutex;
+
+	static uint64_t hashState(const VkSamplerCreateInfo& samplerInfo);
+	static bool equalState(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b);
+};
@@ -0,0 +1,85 @@
+#include "ShaderCompiler.h"
+
+#include <filesystem>
+
+ShaderCompiler::ShaderCompiler(const std::string& cacheDirectory) : cacheDirectory(cacheDirectory)
+{
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+	std::filesystem::create_directories(cacheDirectory);
+}
+
+std::vector<uint32_t> ShaderCompiler::getSpirv(const std::string& sourceFile)
+{
+	std::vector<char> source = readFile(sourceFile);
+	shaderc_shader_kind kind = getShaderKind(sourceFile);
+
+	// key covers everything that changes the output: source, stage and compile options
+	uint64_t hash = hashFnv1a(source.data(), source.size());
+	hash = hashFnv1a(&kind, sizeof(kind), hash);
+	hash = hashFnv1a(&SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION), hash);
+	std::string cachePath = getCachePath(sourceFile, hash);
+
+	// -- CACHE HIT --
+	std::ifstream cacheFile(cachePath, std::ios::binary | std::ios::ate);
+	if (cacheFile.is_open())
+	{
+		size_t fileSize = static_cast<size_t>(cacheFile.tellg());
+		if (fileSize > 0 && fileSize % sizeof(uint32_t) == 0)
+		{
+			std::vector<uint32_t> spirv(fileSize / sizeof(uint32_t));
+			cacheFile.seekg(0);
+			cacheFile.read(reinterpret_cast<char*>(spirv.data()), fileSize);
+			if (cacheFile.good()) return spirv;
+		}
+	}
+
+	// -- COMPILE --
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(std::string(source.begin(), source.end()), kind, sourceFile.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw std::runtime_error("Failed to compile shader " + sourceFile + "!\n" + result.GetErrorMessage());
+	}
+	std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+
+	// -- STORE --
+	// written to a temporary file and renamed, a half written entry would otherwise look like a valid hit
+	std::lock_guard<std::mutex> lock(writeMutex);
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			printf("Shader cache: failed to write %s\n", cachePath.c_str());
+			return spirv;
+		}
+		file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+	}
+	std::filesystem::rename(tempPath, cachePath);
+
+	return spirv;
+}
+
+shaderc_shader_kind ShaderCompiler::getShaderKind(const std::string& fileName)
+{
+	std::string extension = std::filesystem::path(fileName).extension().string();
+	if (extension == ".vert") return shaderc_glsl_vertex_shader;
+	if (extension == ".frag") return shaderc_glsl_fragment_shader;
+	if (extension == ".comp") return shaderc_glsl_compute_shader;
+	if (extension == ".geom") return shaderc_glsl_geometry_shader;
+	if (extension == ".tesc") return shaderc_glsl_tess_control_shader;
+	if (extension == ".tese") return shaderc_glsl_tess_evaluation_shader;
+
+	throw std::runtime_error("Unknown shader stage for " + fileName + "!");
+}
+
+std::string ShaderCompiler::getCachePath(const std::string& sourceFile, uint64_t hash) const
+{
+	char hashText[17];
+	snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(hash));
+
+	// file name first so the cache folder stays readable, e.g. shader.frag.0123456789abcdef.spv
+	std::string fileName = std::filesystem::path(sourceFile).filename().string();
+	return (std::filesystem::path(cacheDirectory) / (fileName + "." + hashText + ".spv")).string();
+}
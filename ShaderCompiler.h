@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+
+#include <shaderc/shaderc.hpp>
+
+#include "Utilities.h"
+
+// Bump whenever compile options change, old cache entries then stop matching
+const uint32_t SHADER_CACHE_VERSION = 1;
+
+// Compiles GLSL sources (.vert, .frag, .comp, ...) to SPIR-V in process with shaderc
+// Results are stored under a hash of the source, so unchanged shaders are read straight from disk and edited ones rebuild on next use
+class ShaderCompiler
+{
+public:
+	ShaderCompiler(const std::string& cacheDirectory);
+
+	// Throws std::runtime_error with the compiler log if the source doesn't compile. Safe to call from several threads
+	std::vector<uint32_t> getSpirv(const std::string& sourceFile);
+
+private:
+	std::string cacheDirectory;
+	shaderc::Compiler compiler;
+	shaderc::CompileOptions options;
+	std::mutex writeMutex;
+
+	static shaderc_shader_kind getShaderKind(const std::string& fileName);
+	std::string getCachePath(const std::string& sourceFile, uint64_t hash) const;
+};
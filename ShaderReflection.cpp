@@ -0,0 +1,401 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <string>
+#include <cstdint>
+
+// Subset of the SPIR-V enums this parser needs (SPIR-V specification, section 3)
+enum SpirvOp : uint32_t
+{
+	OpEntryPoint = 15,
+	OpTypeBool = 20,
+	OpTypeInt = 21,
+	OpTypeFloat = 22,
+	OpTypeVector = 23,
+	OpTypeMatrix = 24,
+	OpTypeImage = 25,
+	OpTypeSampler = 26,
+	OpTypeSampledImage = 27,
+	OpTypeArray = 28,
+	OpTypeRuntimeArray = 29,
+	OpTypeStruct = 30,
+	OpTypePointer = 32,
+	OpConstant = 43,
+	OpVariable = 59,
+	OpDecorate = 71,
+	OpMemberDecorate = 72
+};
+
+enum SpirvStorageClass : uint32_t
+{
+	StorageUniformConstant = 0,
+	StorageInput = 1,
+	StorageUniform = 2,
+	StoragePushConstant = 9,
+	StorageBuffer = 12
+};
+
+enum SpirvDecoration : uint32_t
+{
+	DecorationBufferBlock = 3,
+	DecorationArrayStride = 6,
+	DecorationMatrixStride = 7,
+	DecorationBuiltIn = 11,
+	DecorationLocation = 30,
+	DecorationBinding = 33,
+	DecorationDescriptorSet = 34,
+	DecorationOffset = 35
+};
+
+const uint32_t SPIRV_DIM_BUFFER = 5;
+const uint32_t SPIRV_DIM_SUBPASS_DATA = 6;
+const uint32_t SPIRV_IMAGE_STORAGE = 2;					// "Sampled" operand of OpTypeImage: 1 sampled, 2 storage
+
+ShaderReflection::ShaderReflection(const std::vector<uint32_t>& spirv)
+{
+	if (spirv.size() < 5 || spirv[0] != SPIRV_MAGIC)
+	{
+		throw std::runtime_error("Not a SPIR-V module!");
+	}
+
+	// -- PARSE --
+	// instructions start after the 5 word header, each one is (word count << 16 | opcode) followed by its operands
+	struct Variable { uint32_t id; uint32_t pointerType; uint32_t storageClass; };
+	std::vector<Variable> variables;
+	bool hasEntryPoint = false;
+	uint32_t executionModel = 0;
+
+	for (size_t i = 5; i < spirv.size(); )
+	{
+		uint32_t wordCount = spirv[i] >> 16;
+		uint32_t opcode = spirv[i] & 0xffff;
+		if (wordCount == 0 || i + wordCount > spirv.size())
+		{
+			throw std::runtime_error("Damaged SPIR-V module!");
+		}
+		const uint32_t* operands = &spirv[i + 1];
+		uint32_t operandCount = wordCount - 1;
+
+		switch (opcode)
+		{
+		case OpEntryPoint:
+			if (!hasEntryPoint) executionModel = operands[0];
+			hasEntryPoint = true;
+			break;
+		case OpDecorate:
+			decorations[operands[0]][operands[1]] = operandCount > 2 ? operands[2] : 0;
+			break;
+		case OpMemberDecorate:
+			memberDecorations[(uint64_t(operands[0]) << 32) | operands[1]][operands[2]] = operandCount > 3 ? operands[3] : 0;
+			break;
+		case OpTypeBool: case OpTypeInt: case OpTypeFloat: case OpTypeVector: case OpTypeMatrix: case OpTypeImage:
+		case OpTypeSampler: case OpTypeSampledImage: case OpTypeArray: case OpTypeRuntimeArray: case OpTypeStruct: case OpTypePointer:
+			ids[operands[0]] = { opcode, std::vector<uint32_t>(operands + 1, operands + operandCount) };
+			break;
+		case OpConstant:
+			ids[operands[1]] = { opcode, std::vector<uint32_t>(operands + 2, operands + operandCount) };
+			break;
+		case OpVariable:
+			variables.push_back({ operands[1], operands[0], operands[2] });
+			break;
+		}
+		i += wordCount;
+	}
+
+	if (!hasEntryPoint)
+	{
+		throw std::runtime_error("SPIR-V module has no entry point!");
+	}
+	static const VkShaderStageFlagBits stages[] =
+	{
+		VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+		VK_SHADER_STAGE_GEOMETRY_BIT, VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_COMPUTE_BIT
+	};
+	if (executionModel >= sizeof(stages) / sizeof(stages[0]))
+	{
+		throw std::runtime_error("Unsupported shader stage in SPIR-V module!");
+	}
+	stage = stages[executionModel];
+
+	// -- INTERFACE --
+	for (const Variable& variable : variables)
+	{
+		uint32_t typeId = getId(variable.pointerType).operands[1];		// OpTypePointer: storage class, pointee type
+
+		switch (variable.storageClass)
+		{
+		case StorageUniformConstant:
+		case StorageUniform:
+		case StorageBuffer:
+		{
+			ReflectedBinding binding = {};
+			if (!getDecoration(variable.id, DecorationBinding, &binding.binding)) break;
+			getDecoration(variable.id, DecorationDescriptorSet, &binding.set);		// set 0 when not given
+			binding.descriptorType = getDescriptorType(typeId, variable.storageClass, &binding.descriptorCount);
+			bindings.push_back(binding);
+			break;
+		}
+		case StoragePushConstant:
+		{
+			// the block can start past 0 when several stages share the push constant space
+			uint32_t memberCount = static_cast<uint32_t>(getId(typeId).operands.size());
+			uint32_t offset = UINT32_MAX;
+			for (uint32_t member = 0; member < memberCount; member++)
+			{
+				uint32_t memberOffset = 0;
+				getMemberDecoration(typeId, member, DecorationOffset, &memberOffset);
+				offset = std::min(offset, memberOffset);
+			}
+			pushConstantOffset = memberCount > 0 ? offset : 0;
+			pushConstantSize = getTypeSize(typeId) - pushConstantOffset;
+			break;
+		}
+		case StorageInput:
+		{
+			uint32_t location;
+			if (stage != VK_SHADER_STAGE_VERTEX_BIT || getDecoration(variable.id, DecorationBuiltIn, nullptr)) break;
+			if (!getDecoration(variable.id, DecorationLocation, &location)) break;
+
+			ReflectedVertexInput input = {};
+			input.location = location;
+			input.format = getVertexFormat(typeId, &input.size);
+			vertexInputs.push_back(input);
+			break;
+		}
+		}
+	}
+
+	std::sort(vertexInputs.begin(), vertexInputs.end(),
+		[](const ReflectedVertexInput& a, const ReflectedVertexInput& b) { return a.location < b.location; });
+
+	// only needed while parsing
+	ids.clear();
+	decorations.clear();
+	memberDecorations.clear();
+}
+
+std::vector<VkVertexInputAttributeDescription> ShaderReflection::createVertexAttributes(uint32_t binding, uint32_t* stride) const
+{
+	std::vector<VkVertexInputAttributeDescription> attributes(vertexInputs.size());
+	uint32_t offset = 0;
+	for (size_t i = 0; i < vertexInputs.size(); i++)
+	{
+		attributes[i].binding = binding;
+		attributes[i].location = vertexInputs[i].location;
+		attributes[i].format = vertexInputs[i].format;
+		attributes[i].offset = offset;
+		offset += vertexInputs[i].size;
+	}
+	*stride = offset;
+	return attributes;
+}
+
+ShaderLayout ShaderReflection::mergeLayouts(const std::vector<const ShaderReflection*>& stages)
+{
+	ShaderLayout layout;
+	uint32_t pushConstantEnd = 0;
+
+	for (const ShaderReflection* reflection : stages)
+	{
+		for (const ReflectedBinding& reflected : reflection->bindings)
+		{
+			if (layout.sets.size() <= reflected.set)
+			{
+				layout.sets.resize(reflected.set + 1);
+			}
+			std::vector<VkDescriptorSetLayoutBinding>& set = layout.sets[reflected.set];
+
+			auto existing = std::find_if(set.begin(), set.end(),
+				[&reflected](const VkDescriptorSetLayoutBinding& binding) { return binding.binding == reflected.binding; });
+			if (existing != set.end())
+			{
+				if (existing->descriptorType != reflected.descriptorType || existing->descriptorCount != reflected.descriptorCount)
+				{
+					throw std::runtime_error("Set " + std::to_string(reflected.set) + " binding " + std::to_string(reflected.binding) +
+						" is declared differently by two shader stages!");
+				}
+				existing->stageFlags |= reflection->stage;
+				continue;
+			}
+
+			VkDescriptorSetLayoutBinding binding = {};
+			binding.binding = reflected.binding;
+			binding.descriptorType = reflected.descriptorType;
+			binding.descriptorCount = reflected.descriptorCount;
+			binding.stageFlags = reflection->stage;
+			binding.pImmutableSamplers = nullptr;
+			set.push_back(binding);
+		}
+
+		// one range covering every stage, pushes then always use the full stage mask
+		if (reflection->pushConstantSize > 0)
+		{
+			uint32_t start = layout.pushConstantRange.stageFlags ? std::min(layout.pushConstantRange.offset, reflection->pushConstantOffset) : reflection->pushConstantOffset;
+			pushConstantEnd = std::max(pushConstantEnd, reflection->pushConstantOffset + reflection->pushConstantSize);
+			layout.pushConstantRange.stageFlags |= reflection->stage;
+			layout.pushConstantRange.offset = start;
+			layout.pushConstantRange.size = pushConstantEnd - start;
+		}
+	}
+
+	for (std::vector<VkDescriptorSetLayoutBinding>& set : layout.sets)
+	{
+		std::sort(set.begin(), set.end(),
+			[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	}
+	return layout;
+}
+
+bool ShaderReflection::equalLayouts(const ShaderLayout& a, const ShaderLayout& b)
+{
+	if (a.sets.size() != b.sets.size()) return false;
+	for (size_t s = 0; s < a.sets.size(); s++)
+	{
+		if (a.sets[s].size() != b.sets[s].size()) return false;
+		for (size_t i = 0; i < a.sets[s].size(); i++)
+		{
+			const VkDescriptorSetLayoutBinding& bindingA = a.sets[s][i];
+			const VkDescriptorSetLayoutBinding& bindingB = b.sets[s][i];
+			if (bindingA.binding != bindingB.binding || bindingA.descriptorType != bindingB.descriptorType ||
+				bindingA.descriptorCount != bindingB.descriptorCount || bindingA.stageFlags != bindingB.stageFlags) return false;
+		}
+	}
+	return a.pushConstantRange.stageFlags == b.pushConstantRange.stageFlags && a.pushConstantRange.offset == b.pushConstantRange.offset &&
+		a.pushConstantRange.size == b.pushConstantRange.size;
+}
+
+const ShaderReflection::SpirvId& ShaderReflection::getId(uint32_t id) const
+{
+	auto found = ids.find(id);
+	if (found == ids.end())
+	{
+		throw std::runtime_error("SPIR-V module references an undeclared id!");
+	}
+	return found->second;
+}
+
+bool ShaderReflection::getDecoration(uint32_t id, uint32_t decoration, uint32_t* value) const
+{
+	auto idDecorations = decorations.find(id);
+	if (idDecorations == decorations.end()) return false;
+
+	auto found = idDecorations->second.find(decoration);
+	if (found == idDecorations->second.end()) return false;
+
+	if (value != nullptr) *value = found->second;
+	return true;
+}
+
+bool ShaderReflection::getMemberDecoration(uint32_t structId, uint32_t member, uint32_t decoration, uint32_t* value) const
+{
+	auto memberDecoration = memberDecorations.find((uint64_t(structId) << 32) | member);
+	if (memberDecoration == memberDecorations.end()) return false;
+
+	auto found = memberDecoration->second.find(decoration);
+	if (found == memberDecoration->second.end()) return false;
+
+	if (value != nullptr) *value = found->second;
+	return true;
+}
+
+uint32_t ShaderReflection::getTypeSize(uint32_t typeId, uint32_t matrixStride) const
+{
+	const SpirvId& type = getId(typeId);
+	switch (type.opcode)
+	{
+	case OpTypeBool:
+		return 4;
+	case OpTypeInt:
+	case OpTypeFloat:
+		return type.operands[0] / 8;												// width in bits
+	case OpTypeVector:
+		return type.operands[1] * getTypeSize(type.operands[0]);					// component type, component count
+	case OpTypeMatrix:
+		// column type, column count. Block members carry their column stride, std140/std430 may pad columns
+		return type.operands[1] * (matrixStride > 0 ? matrixStride : getTypeSize(type.operands[0]));
+	case OpTypeArray:
+	{
+		uint32_t length = getId(type.operands[1]).operands[0];
+		uint32_t arrayStride;
+		return length * (getDecoration(typeId, DecorationArrayStride, &arrayStride) ? arrayStride : getTypeSize(type.operands[0]));
+	}
+	case OpTypeStruct:
+	{
+		// end of the member that ends last, members are laid out by their Offset decorations
+		uint32_t size = 0;
+		for (uint32_t member = 0; member < type.operands.size(); member++)
+		{
+			uint32_t offset = 0;
+			uint32_t memberMatrixStride = 0;
+			getMemberDecoration(typeId, member, DecorationOffset, &offset);
+			getMemberDecoration(typeId, member, DecorationMatrixStride, &memberMatrixStride);
+			size = std::max(size, offset + getTypeSize(type.operands[member], memberMatrixStride));
+		}
+		return size;
+	}
+	}
+	throw std::runtime_error("SPIR-V type has no fixed size!");
+}
+
+VkDescriptorType ShaderReflection::getDescriptorType(uint32_t typeId, uint32_t storageClass, uint32_t* count) const
+{
+	// arrays of descriptors, runtime sized ones are counted as 1
+	*count = 1;
+	const SpirvId* type = &getId(typeId);
+	while (type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray)
+	{
+		if (type->opcode == OpTypeArray)
+		{
+			*count *= getId(type->operands[1]).operands[0];
+		}
+		typeId = type->operands[0];
+		type = &getId(typeId);
+	}
+
+	switch (type->opcode)
+	{
+	case OpTypeSampledImage:
+		return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	case OpTypeSampler:
+		return VK_DESCRIPTOR_TYPE_SAMPLER;
+	case OpTypeImage:
+	{
+		// sampled type, dim, depth, arrayed, multisampled, sampled, format
+		uint32_t dim = type->operands[1];
+		bool storage = type->operands[5] == SPIRV_IMAGE_STORAGE;
+		if (dim == SPIRV_DIM_SUBPASS_DATA) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		if (dim == SPIRV_DIM_BUFFER) return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	}
+	case OpTypeStruct:
+		// SPIR-V 1.0 (glslang for Vulkan 1.0) marks storage buffers as Uniform + BufferBlock
+		if (storageClass == StorageBuffer || getDecoration(typeId, DecorationBufferBlock, nullptr)) return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+	throw std::runtime_error("Unsupported descriptor type in SPIR-V module!");
+}
+
+VkFormat ShaderReflection::getVertexFormat(uint32_t typeId, uint32_t* size) const
+{
+	const SpirvId* type = &getId(typeId);
+	uint32_t componentCount = 1;
+	if (type->opcode == OpTypeVector)
+	{
+		componentCount = type->operands[1];
+		type = &getId(type->operands[0]);
+	}
+
+	static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+	// 32 bit scalars and vectors only, matrices would take one location per column
+	if (componentCount < 1 || componentCount > 4 || (type->opcode != OpTypeFloat && type->opcode != OpTypeInt) || type->operands[0] != 32)
+	{
+		throw std::runtime_error("Unsupported vertex input type in SPIR-V module!");
+	}
+
+	*size = componentCount * 4;
+	if (type->opcode == OpTypeFloat) return floatFormats[componentCount - 1];
+	return type->operands[1] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];		// OpTypeInt: width, signedness
+}
@@ -0,0 +1,78 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+struct ReflectedBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	uint32_t descriptorCount;				// > 1 for arrays of descriptors
+};
+
+struct ReflectedVertexInput
+{
+	uint32_t location;
+	VkFormat format;
+	uint32_t size;							// bytes taken in the vertex
+};
+
+// Descriptor sets and push constants of all stages of a pipeline
+struct ShaderLayout
+{
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;		// by set number, bindings sorted by binding number
+	VkPushConstantRange pushConstantRange = {};						// size 0 if no stage uses push constants
+};
+
+// Reads descriptor bindings, push constants and vertex inputs straight from a SPIR-V module
+// Only the first entry point is looked at, which is all glslang emits for a single GLSL file
+class ShaderReflection
+{
+public:
+	ShaderReflection(const std::vector<uint32_t>& spirv);
+
+	VkShaderStageFlagBits getStage() const { return stage; }
+	const std::vector<ReflectedBinding>& getBindings() const { return bindings; }
+	uint32_t getPushConstantOffset() const { return pushConstantOffset; }
+	uint32_t getPushConstantSize() const { return pushConstantSize; }
+	const std::vector<ReflectedVertexInput>& getVertexInputs() const { return vertexInputs; }
+
+	// Attributes of a single interleaved binding, packed in location order (the vertex struct has to declare them the same way)
+	std::vector<VkVertexInputAttributeDescription> createVertexAttributes(uint32_t binding, uint32_t* stride) const;
+
+	// Combines the stages of one pipeline, a binding used by several stages gets all their stage flags
+	static ShaderLayout mergeLayouts(const std::vector<const ShaderReflection*>& stages);
+	static bool equalLayouts(const ShaderLayout& a, const ShaderLayout& b);
+
+private:
+	struct SpirvId
+	{
+		uint32_t opcode = 0;
+		std::vector<uint32_t> operands;		// everything after the result id (for OpConstant: everything after the result type)
+	};
+
+	VkShaderStageFlagBits stage;
+	std::vector<ReflectedBinding> bindings;
+	uint32_t pushConstantOffset = 0;
+	uint32_t pushConstantSize = 0;
+	std::vector<ReflectedVertexInput> vertexInputs;
+
+	// parse state, types and constants by result id
+	std::unordered_map<uint32_t, SpirvId> ids;
+	std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> decorations;			// id -> decoration -> first literal
+	std::unordered_map<uint64_t, std::unordered_map<uint32_t, uint32_t>> memberDecorations;		// struct id << 32 | member -> decoration -> first literal
+
+	const SpirvId& getId(uint32_t id) const;
+	bool getDecoration(uint32_t id, uint32_t decoration, uint32_t* value) const;
+	bool getMemberDecoration(uint32_t structId, uint32_t member, uint32_t decoration, uint32_t* value) const;
+
+	uint32_t getTypeSize(uint32_t typeId, uint32_t matrixStride = 0) const;
+	VkDescriptorType getDescriptorType(uint32_t typeId, uint32_t storageClass, uint32_t* count) const;
+	VkFormat getVertexFormat(uint32_t typeId, uint32_t* size) const;
+};
@@ -0,0 +1,126 @@
+#include "ShaderWatcher.h"
+
+#include <stdexcept>
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher(const std::string& directory) : directory(directory), running(true)
+{
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		throw std::runtime_error("Failed to initialise inotify!");
+	}
+	// editors either rewrite the file in place or write a copy and rename it over the original
+	if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(inotifyFd);
+		throw std::runtime_error("Failed to watch shader directory! (" + directory + ")");
+	}
+#else
+	scanWriteTimes(false);
+#endif
+
+	thread = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	running = false;
+	thread.join();
+
+#ifdef __linux__
+	close(inotifyFd);
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::takeChangedFiles()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::string> files(changedFiles.begin(), changedFiles.end());
+	changedFiles.clear();
+	return files;
+}
+
+void ShaderWatcher::watchLoop()
+{
+	while (running)
+	{
+#ifdef __linux__
+		// short timeout so the destructor never waits long for the thread
+		pollfd pollInfo = {};
+		pollInfo.fd = inotifyFd;
+		pollInfo.events = POLLIN;
+		if (poll(&pollInfo, 1, 100) <= 0) continue;
+
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* entry = buffer; entry < buffer + length; )
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(entry);
+				if (event->len > 0)
+				{
+					addChange(event->name);
+				}
+				entry += sizeof(inotify_event) + event->len;
+			}
+		}
+#else
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		scanWriteTimes(true);
+#endif
+	}
+}
+
+#ifndef __linux__
+void ShaderWatcher::scanWriteTimes(bool reportChanges)
+{
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		std::string fileName = entry.path().filename().string();
+		if (!isShaderSource(fileName)) continue;
+
+		std::filesystem::file_time_type writeTime = entry.last_write_time(error);
+		if (error) continue;		// file is being replaced right now, next scan picks it up
+
+		auto known = writeTimes.find(fileName);
+		if (known == writeTimes.end() || known->second != writeTime)
+		{
+			writeTimes[fileName] = writeTime;
+			if (reportChanges) addChange(fileName);
+		}
+	}
+}
+#endif
+
+void ShaderWatcher::addChange(const std::string& fileName)
+{
+	if (!isShaderSource(fileName)) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	changedFiles.insert(directory + "/" + fileName);
+}
+
+bool ShaderWatcher::isShaderSource(const std::string& fileName)
+{
+	static const char* extensions[] = { ".vert", ".frag", ".comp", ".geom", ".tesc", ".tese" };
+	for (const char* extension : extensions)
+	{
+		size_t length = strlen(extension);
+		if (fileName.size() > length && fileName.compare(fileName.size() - length, length, extension) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#ifndef __linux__
+#include <filesystem>
+#include <unordered_map>
+#endif
+
+// Watches a directory for edited shader sources on a background thread
+// inotify on Linux, elsewhere the write times are polled
+class ShaderWatcher
+{
+public:
+	ShaderWatcher(const std::string& directory);
+	~ShaderWatcher();
+
+	// Shader sources changed since the last call (as directory/file), never blocks
+	std::vector<std::string> takeChangedFiles();
+
+private:
+	std::string directory;
+	std::thread thread;
+	std::atomic<bool> running;
+
+	std::mutex mutex;
+	std::set<std::string> changedFiles;
+
+#ifdef __linux__
+	int inotifyFd = -1;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+	void scanWriteTimes(bool reportChanges);
+#endif
+
+	void watchLoop();
+	void addChange(const std::string& fileName);
+	static bool isShaderSource(const std::string& fileName);
+};
@@ -0,0 +1,49 @@
+#version 450
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoordinates;
+layout(location = 2) in vec3 fragWorldPosition;
+
+layout(set = 1, binding = 0) uniform sampler2DArray textureSampler;
+
+// after the model matrix of the vertex stage
+layout(push_constant) uniform PushTexture
+{
+    layout(offset = 64) uint textureLayer;
+} pushTexture;
+
+// Pipeline variant features (PipelineFeatureBits), same ids as shader.frag
+// FOG needs the lit colour, it has no effect on the deferred path
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const bool FOG = false;
+
+const float ALPHA_CUTOFF = 0.5f;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outPosition;
+layout(location = 2) out vec4 outNormal;
+
+void main()
+{
+    vec4 color = vec4(1.0f);
+    if (TEXTURED)
+    {
+        color *= texture(textureSampler, vec3(fragTexCoordinates, pushTexture.textureLayer));
+    }
+    if (VERTEX_COLOR)
+    {
+        color.rgb *= fragColor;
+    }
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+    {
+        discard;
+    }
+
+    // vertices carry no normals, the face normal comes from the screen space derivatives of the position
+    vec3 normal = normalize(cross(dFdx(fragWorldPosition), dFdy(fragWorldPosition)));
+
+    outAlbedo = color;
+    outPosition = vec4(fragWorldPosition, 1.0f);
+    outNormal = vec4(normal, 0.0f);
+}
@@ -0,0 +1,53 @@
+#version 450
+
+// G-buffer written by the previous subpass, read from tile memory at this pixel
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput inputAlbedo;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput inputPosition;
+layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput inputNormal;
+
+const uint MAX_LIGHTS = 64;
+
+struct Light
+{
+    vec4 position;      // world position (xyz), radius (w)
+    vec4 color;         // colour (rgb), intensity (a)
+};
+
+layout(set = 0, binding = 3) uniform UboLights
+{
+    vec4 ambient;
+    uint lightCount;
+    Light lights[MAX_LIGHTS];
+} uboLights;
+
+layout(location = 0) out vec4 result;
+
+void main()
+{
+    vec4 position = subpassLoad(inputPosition);
+    if (position.w == 0.0f)
+    {
+        result = vec4(0.0f, 0.0f, 0.0f, 1.0f);      // nothing drawn here, matches the forward clear colour
+        return;
+    }
+    vec3 albedo = subpassLoad(inputAlbedo).rgb;
+    vec3 normal = subpassLoad(inputNormal).xyz;
+
+    vec3 color = uboLights.ambient.rgb * albedo;
+    for (uint i = 0; i < min(uboLights.lightCount, MAX_LIGHTS); i++)
+    {
+        vec3 toLight = uboLights.lights[i].position.xyz - position.xyz;
+        float lightDistance = length(toLight);
+        float radius = uboLights.lights[i].position.w;
+        if (lightDistance >= radius)
+        {
+            continue;
+        }
+
+        // derivative normals have no reliable facing, faces are lit from both sides
+        float diffuse = abs(dot(normal, toLight / lightDistance));
+        float attenuation = 1.0f - lightDistance / radius;
+        color += albedo * uboLights.lights[i].color.rgb * uboLights.lights[i].color.a * diffuse * attenuation * attenuation;
+    }
+    result = vec4(color, 1.0f);
+}
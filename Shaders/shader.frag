@@ -1,13 +1,47 @@
 #version 450
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoordinates;
+layout(location = 2) in float fragViewDistance;
 
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+layout(set = 1, binding = 0) uniform sampler2DArray textureSampler;
+
+// after the model matrix of the vertex stage
+layout(push_constant) uniform PushTexture
+{
+    layout(offset = 64) uint textureLayer;
+} pushTexture;
+
+// Pipeline variant features (PipelineFeatureBits), disabled paths are removed when the pipeline is built
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const bool FOG = false;
+
+const float ALPHA_CUTOFF = 0.5f;
+const float FOG_DENSITY = 0.15f;
+const vec3 FOG_COLOR = vec3(0.0f);			// matches the clear colour
 
 layout(location = 0) out vec4 result;
 
 void main()
 {
-    result = texture(textureSampler, fragTexCoordinates);
-    //result = vec4(fragColor, 1.0f);
-}
\ No newline at end of file
+    vec4 color = vec4(1.0f);
+    if (TEXTURED)
+    {
+        color *= texture(textureSampler, vec3(fragTexCoordinates, pushTexture.textureLayer));
+    }
+    if (VERTEX_COLOR)
+    {
+        color.rgb *= fragColor;
+    }
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+    {
+        discard;
+    }
+    if (FOG)
+    {
+        float visibility = exp(-FOG_DENSITY * fragViewDistance);
+        color.rgb = mix(FOG_COLOR, color.rgb, clamp(visibility, 0.0f, 1.0f));
+    }
+    result = color;
+}
@@ -19,10 +19,13 @@ layout(push_constant) uniform PushModel
 
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 fragTexCoordinates;
+layout (location = 2) out float fragViewDistance;
 
 void main()
 {
-    gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0f);
+    vec4 viewPosition = uboViewProjection.view * pushModel.model * vec4(pos, 1.0f);
+    gl_Position = uboViewProjection.projection * viewPosition;
+    fragViewDistance = length(viewPosition.xyz);
     fragColor = color;
     fragTexCoordinates = texCoordinates;
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "StagingBuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+StagingBuffer::StagingBuffer(Device device, VkDeviceSize size) : device(device), size(size)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device.logical, &bufferInfo, nullptr, &buffer);
+	checkResult(result, "Failed to create staging buffer");
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device.logical, buffer, &memRequirements);
+
+	// first match wins, host visible memory is all that is required
+	const VkMemoryPropertyFlags preferredProperties[] = {
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+	};
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(device.physical, &memProperties);
+
+	uint32_t memoryTypeIndex = UINT32_MAX;
+	for (VkMemoryPropertyFlags properties : preferredProperties)
+	{
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount && memoryTypeIndex == UINT32_MAX; i++)
+		{
+			if ((memRequirements.memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				memoryTypeIndex = i;
+				coherent = (properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+			}
+		}
+	}
+	if (memoryTypeIndex == UINT32_MAX)
+	{
+		throw std::runtime_error("No host visible memory for the staging buffer!");
+	}
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = memRequirements.size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	result = vkAllocateMemory(device.logical, &memoryAllocInfo, nullptr, &memory);
+	checkResult(result, "Failed to allocate staging buffer memory");
+	vkBindBufferMemory(device.logical, buffer, memory, 0);
+
+	void* data;
+	result = vkMapMemory(device.logical, memory, 0, VK_WHOLE_SIZE, 0, &data);
+	checkResult(result, "Failed to map staging buffer memory");
+	mapped = static_cast<char*>(data);
+
+	// 16 covers the texel size of every uncompressed and block compressed format
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(device.physical, &deviceProperties);
+	alignment = std::max<VkDeviceSize>(16, coherent ? 1 : deviceProperties.limits.nonCoherentAtomSize);
+
+	freeRanges[0] = size;
+}
+
+StagingBuffer::~StagingBuffer()
+{
+	vkUnmapMemory(device.logical, memory);
+	vkDestroyBuffer(device.logical, buffer, nullptr);
+	vkFreeMemory(device.logical, memory, nullptr);
+}
+
+bool StagingBuffer::allocate(VkDeviceSize allocationSize, StagingAllocation* allocation)
+{
+	VkDeviceSize alignedSize = (allocationSize + alignment - 1) / alignment * alignment;
+
+	// first fit, offsets stay aligned because every range size is a multiple of the alignment
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+	{
+		if (range->second < alignedSize) continue;
+
+		VkDeviceSize offset = range->first;
+		VkDeviceSize remaining = range->second - alignedSize;
+		freeRanges.erase(range);
+		if (remaining > 0) freeRanges[offset + alignedSize] = remaining;
+
+		allocation->offset = offset;
+		allocation->size = alignedSize;
+		allocation->data = mapped + offset;
+		return true;
+	}
+	return false;
+}
+
+void StagingBuffer::release(const StagingAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	VkDeviceSize offset = allocation.offset;
+	VkDeviceSize rangeSize = allocation.size;
+
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && offset + rangeSize == next->first)
+	{
+		rangeSize += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += rangeSize;
+			return;
+		}
+	}
+	freeRanges[offset] = rangeSize;
+}
+
+void StagingBuffer::flush(const StagingAllocation& allocation)
+{
+	if (coherent) return;
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = memory;
+	range.offset = allocation.offset;
+	range.size = allocation.offset + allocation.size == size ? VK_WHOLE_SIZE : allocation.size;
+	VkResult result = vkFlushMappedMemoryRanges(device.logical, 1, &range);
+	checkResult(result, "Failed to flush staging buffer memory");
+}
+
+// -- DECODE HOOKS --
+// Each decoding thread has its own target, workers decode independently
+namespace
+{
+	thread_local void* decodeTarget = nullptr;
+	thread_local size_t decodeTargetSize = 0;
+	thread_local bool decodeTargetUsed = false;
+}
+
+void setDecodeTarget(void* target, size_t size)
+{
+	decodeTarget = target;
+	decodeTargetSize = size;
+	decodeTargetUsed = false;
+}
+
+void* decodeMalloc(size_t size)
+{
+	// the RGBA output is the first allocation of its size, intermediate buffers have other sizes in practice
+	if (decodeTarget != nullptr && !decodeTargetUsed && size == decodeTargetSize)
+	{
+		decodeTargetUsed = true;
+		return decodeTarget;
+	}
+	return malloc(size);
+}
+
+void* decodeRealloc(void* data, size_t oldSize, size_t newSize)
+{
+	if (data == nullptr || data != decodeTarget) return realloc(data, newSize);
+
+	// an intermediate buffer got the target after all, it moves to the heap and the target is free again
+	void* moved = malloc(newSize);
+	if (moved == nullptr) return nullptr;
+	memcpy(moved, data, std::min(oldSize, newSize));
+	decodeTargetUsed = false;
+	return moved;
+}
+
+void decodeFree(void* data)
+{
+	if (data != nullptr && data == decodeTarget)
+	{
+		decodeTargetUsed = false;
+		return;
+	}
+	free(data);
+}
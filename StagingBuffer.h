@@ -0,0 +1,48 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Persistently mapped upload buffer, sub-allocated by several threads at once. Ranges can be released in any order
+// Host cached memory is preferred: decoders read back what they wrote (PNG filters use the previous row), which is very slow on write-combined memory
+class StagingBuffer
+{
+public:
+	StagingBuffer(Device device, VkDeviceSize size);
+	~StagingBuffer();
+
+	// false when no free range is large enough, the caller falls back to a buffer of its own
+	bool allocate(VkDeviceSize size, StagingAllocation* allocation);
+	void release(const StagingAllocation& allocation);
+	// Makes host writes visible to the device, nothing to do on coherent memory
+	void flush(const StagingAllocation& allocation);
+
+#pragma region getters
+	VkBuffer getBuffer() const { return buffer; }
+	VkDeviceSize getSize() const { return size; }
+#pragma endregion
+
+private:
+	Device device;
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	char* mapped;
+	VkDeviceSize size;
+	VkDeviceSize alignment;								// copy offsets, and flush ranges on non coherent memory
+	bool coherent;
+
+	std::map<VkDeviceSize, VkDeviceSize> freeRanges;	// offset -> size, adjacent ranges are merged
+	std::mutex mutex;
+};
+
+// stb_image allocation hooks, defined as STBI_MALLOC, STBI_REALLOC_SIZED and STBI_FREE in main.cpp
+// While a decode target is set on the calling thread, the first allocation of exactly its size is placed there instead of the heap
+void setDecodeTarget(void* target, size_t size);
+void* decodeMalloc(size_t size);
+void* decodeRealloc(void* data, size_t oldSize, size_t newSize);
+void decodeFree(void* data);
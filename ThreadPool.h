@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Fixed set of worker threads running submitted jobs in FIFO order
+class ThreadPool
+{
+public:
+	ThreadPool(size_t threadCount = 0);		// 0: one worker per hardware thread, leaving one for the main thread
+	~ThreadPool();
+
+	// Exceptions thrown by the job are rethrown by the future's get()
+	template<typename F>
+	auto submit(F job) -> std::future<decltype(job())>
+	{
+		auto task = std::make_shared<std::packaged_task<decltype(job())()>>(std::move(job));
+		std::future<decltype(job())> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task]() { (*task)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+
+	size_t getThreadCount() const { return workers.size(); }
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+
+	void workerLoop();
+};
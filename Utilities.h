@@ -1,5 +1,8 @@
 #pragma once
 #include <fstream>
+#include <vector>
+#include <array>
+#include <algorithm>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -7,8 +10,35 @@
 #include <GLM\glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 
+#include "VertexPacking.h"
+
 const size_t MAX_FRAME_DRAWS = 2;
-const size_t MAX_OBJECTS = 2;
+const size_t MAX_OBJECTS = 256;											// texture descriptor sets
+const VkDeviceSize STAGING_BUFFER_SIZE = 64 * 1024 * 1024;				// shared by texture decodes in flight
+const VkDeviceSize STREAMING_WINDOW_SIZE = 8 * 1024 * 1024;				// tiled uploads of pre-compressed textures, two halves in flight
+const int TEXTURE_ARRAY_MAX_EXTENT = 512;								// decoded textures up to this size share array images with others of their extent
+const char* const PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+const char* const SHADER_CACHE_DIRECTORY = "ShaderCache";
+const char* const SHADER_DIRECTORY = "Shaders";
+const char* const MESH_CACHE_DIRECTORY = "MeshCache";					// imported models as mesh blobs, next to the executable
+const char* const VERTEX_SHADER_FILE = "Shaders/shader.vert";
+const char* const FRAGMENT_SHADER_FILE = "Shaders/shader.frag";
+const char* const GBUFFER_VERTEX_SHADER_FILE = "Shaders/gbuffer.vert";
+const char* const GBUFFER_FRAGMENT_SHADER_FILE = "Shaders/gbuffer.frag";
+const char* const LIGHTING_VERTEX_SHADER_FILE = "Shaders/lighting.vert";
+const char* const LIGHTING_FRAGMENT_SHADER_FILE = "Shaders/lighting.frag";
+
+const size_t MAX_LIGHTS = 64;											// matches MAX_LIGHTS in lighting.frag
+// G-buffer attachments in subpass order: albedo, world position (w = 0 where nothing was drawn), normal
+const std::array<VkFormat, 3> GBUFFER_FORMATS = { VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT };
+
+// Options fixed when the renderer is created
+struct RendererSettings
+{
+	bool deferred = false;				// G-buffer and lighting subpasses in one render pass instead of the forward pass
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;		// requested, lowered to what the device supports. Forward path only
+	VertexLayout vertexLayout = VertexLayout::Packed;				// vertex buffer layout of every mesh, baked blobs have to match
+};
 
 struct Vertex
 {
@@ -30,6 +60,117 @@ struct UboViewProjection
 	}
 };
 
+// Point light, laid out for std140
+struct Light
+{
+	glm::vec4 position;			// world position (xyz), radius (w)
+	glm::vec4 color;			// colour (rgb), intensity (a)
+};
+struct UboLights
+{
+	glm::vec4 ambient;
+	uint32_t lightCount;
+	uint32_t padding[3];		// std140 aligns the array to 16 bytes
+	Light lights[MAX_LIGHTS];
+};
+
+// Pipeline variant features, bit i is the bool specialization constant with constant_id i in the shaders
+enum PipelineFeatureBits : uint32_t
+{
+	PIPELINE_FEATURE_TEXTURED		= 1 << 0,		// sample the texture of set 1
+	PIPELINE_FEATURE_VERTEX_COLOR	= 1 << 1,		// multiply by the vertex colour
+	PIPELINE_FEATURE_ALPHA_TEST		= 1 << 2,		// discard fragments below the alpha cutoff
+	PIPELINE_FEATURE_FOG			= 1 << 3,		// exponential distance fog towards the clear colour
+};
+typedef uint32_t PipelineFeatures;
+const uint32_t PIPELINE_FEATURE_COUNT = 4;
+const PipelineFeatures PIPELINE_FEATURES_DEFAULT = PIPELINE_FEATURE_TEXTURED;
+
+struct PipelineBuildResult
+{
+	PipelineFeatures features;
+	VkPipeline pipeline;
+	double buildMs;				// per pipeline with VK_EXT_pipeline_creation_feedback, otherwise the batch time split evenly
+	bool cacheHit;				// only known with VK_EXT_pipeline_creation_feedback
+	bool registryHit;			// equivalent state was already built, the existing pipeline was handed out
+};
+
+// Pipelines rebuilt on a background thread after shader sources changed, swapped in by the render loop
+struct ShaderReload
+{
+	VkShaderModule vertexModule = VK_NULL_HANDLE;						// VK_NULL_HANDLE if the graphics shaders didn't change, the pipelines
+																		// are then stale variants rebuilt with the current modules
+	VkShaderModule fragModule = VK_NULL_HANDLE;
+	std::vector<PipelineBuildResult> graphicsPipelines;
+	std::vector<std::pair<size_t, VkPipeline>> computePipelines;		// compute pipeline id, rebuilt pipeline
+};
+
+// Replaced pipeline waiting for the frames that may still use it
+struct RetiredPipeline
+{
+	VkPipeline pipeline;
+	uint64_t destroyFrame;			// safe to destroy once this frame's fence has been waited on
+};
+
+// Mip level of a texture upload, offset into the uploaded data
+struct TextureLevel
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Range of the persistently mapped staging buffer
+struct StagingAllocation
+{
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* data = nullptr;				// mapped pointer to offset
+};
+
+// Texture decoded on a worker thread, with as many 8 bit components as its format
+struct DecodedTexture
+{
+	unsigned char* pixels = nullptr;	// in the staging allocation, or allocated by stb_image if the staging buffer was full
+	int width = 0;
+	int height = 0;
+	int components = 4;
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	VkDeviceSize size = 0;
+	StagingAllocation staging;
+};
+
+// Sampler a texture asks for, turned into a VkSamplerCreateInfo and shared through the SamplerCache
+struct SamplerState
+{
+	VkFilter filter = VK_FILTER_LINEAR;										// magnification and minification
+	VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;		// U, V and W
+	float maxAnisotropy = 16.0f;											// 1 disables anisotropic filtering
+};
+
+// What a mesh's texture id refers to: one layer of a texture image, bound through the image's descriptor set
+struct TextureLayer
+{
+	size_t descriptorId;
+	uint32_t layer;
+};
+
+// Per draw push constants, matches PushModel in the vertex shaders and PushTexture in the fragment shaders
+struct PushModel
+{
+	glm::mat4 model;
+	uint32_t textureLayer;
+};
+
+struct FrameTimings
+{
+	double drawBlockedMs = 0.0;		// CPU time draw() spent waiting on the frame fence and acquiring a swapchain image
+	double gpuMs = 0.0;				// GPU time between the first and last command of the frame
+	bool gpuValid = false;			// GPU time is only valid once the frame's timestamp queries have been read back
+};
+
 struct Device
 {
 	VkPhysicalDevice physical;
@@ -38,6 +179,10 @@ struct Device
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
+// Enabled when the device has them, the renderer works without
+const std::vector<const char*> optionalDeviceExtensions = {
+	VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME
+};
 static void checkResult(const VkResult& result, const char* errorMessage)
 {
 	if (result != VK_SUCCESS)
@@ -49,14 +194,36 @@ static void checkResult(const VkResult& result, const char* errorMessage)
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;			// Location of Graphics Queue Family
 	int presentationFamily = -1;		// Location of Presentation Queue Family
+	int computeFamily = -1;				// Location of Compute Queue Family (dedicated async family if the device has one)
 
 	// Check if queue families are valid
 	bool isValid()
 	{
-		return graphicsFamily >= 0 && presentationFamily >= 0;
+		return graphicsFamily >= 0 && presentationFamily >= 0 && computeFamily >= 0;
 	}
 };
 
+struct ComputePipeline
+{
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	std::string fileName;				// source, rebuilt when it changes on disk
+	std::vector<VkDescriptorSetLayout> setLayouts;		// reflected from the shader, owned by the layout cache
+};
+
+// A dispatch recorded on the compute queue every frame, before the graphics work that consumes its output
+// Written resources are per frame in flight, since compute of frame N overlaps rasterization of frame N-1
+struct ComputeDispatch
+{
+	size_t pipelineId;
+	std::array<VkDescriptorSet, MAX_FRAME_DRAWS> descriptorSets;		// set 0, one per frame in flight
+	std::array<VkBuffer, MAX_FRAME_DRAWS> outputBuffers;				// buffers the graphics queue reads afterwards (VK_NULL_HANDLE if none)
+	std::vector<uint8_t> pushConstants;
+	uint32_t groupCountX = 1;
+	uint32_t groupCountY = 1;
+	uint32_t groupCountZ = 1;
+};
+
 struct SwapChainDetails 
 {
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;		// Surface properties, e.g. image size/extent
@@ -66,7 +233,7 @@ struct SwapChainDetails
 struct SwapChainImage
 {
 	VkImage image;
-	VkImage imageView;
+	VkImageView imageView;
 };
 static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t allowedTypes, VkMemoryPropertyFlags properties)
 {
@@ -118,6 +285,18 @@ static void createCompleteBuffer(VkPhysicalDevice physicalDevice, VkDevice logic
 
 	vkBindBufferMemory(logicalDevice, *completeBufferInfo->pBuffer, *completeBufferInfo->pBufferMemory, 0);
 }
+// FNV-1a 64, pass the previous result as hash to continue over several pieces of data
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+static uint64_t hashFnv1a(const void* data, size_t size, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 static std::vector<char> readFile(const std::string& fileName)
 {
 	//std:binary tells to read file as binary
@@ -197,12 +376,13 @@ static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool tra
 	endAndSubmitCommandBuffer(device, transferCmdPool, transferQueue, transferCmdBuffer);
 
 }
-static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCmdPool, VkBuffer srcBuffer, VkImage dstImage, uint32_t width, uint32_t height)
+static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCmdPool, VkBuffer srcBuffer, VkImage dstImage, uint32_t width, uint32_t height,
+	VkDeviceSize srcOffset = 0)
 {
 	VkCommandBuffer transferCmdBuffer = beginCommandBuffer(device, transferCmdPool);
 
 	VkBufferImageCopy imageCopyRegion{};
-	imageCopyRegion.bufferOffset = 0;
+	imageCopyRegion.bufferOffset = srcOffset;
 	imageCopyRegion.bufferRowLength = 0;
 	imageCopyRegion.bufferImageHeight = 0;
 	imageCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -255,7 +435,8 @@ static void createBuffer(Device device, VkDeviceSize bufferSize, VkBufferUsageFl
 	vkBindBufferMemory(device.logical, *buffer, *bufferMemory, 0);
 }
 
-static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels = 1,
+	uint32_t layerCount = 1)
 {
 	VkCommandBuffer cmdBuffer = beginCommandBuffer(device, cmdPool);
 
@@ -269,9 +450,9 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 	imgMemBarrier.image = image;
 	imgMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	imgMemBarrier.subresourceRange.baseMipLevel = 0;
-	imgMemBarrier.subresourceRange.levelCount = 1;
+	imgMemBarrier.subresourceRange.levelCount = mipLevels;						// every level moves together
 	imgMemBarrier.subresourceRange.baseArrayLayer = 0;
-	imgMemBarrier.subresourceRange.layerCount = 1;
+	imgMemBarrier.subresourceRange.layerCount = layerCount;
 
 
 	VkPipelineStageFlags srcStage;
@@ -306,5 +487,151 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 	);
 
 
+	endAndSubmitCommandBuffer(device, cmdPool, queue, cmdBuffer);
+}
+
+// Greyscale sources are stored in R8 (grey) or R8G8 (grey, alpha) and read back through the view as grey RGB, like the RGBA expansion did
+static VkComponentMapping textureSwizzle(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SRGB:
+		return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE };
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SRGB:
+		return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G };
+	default:
+		return { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+	}
+}
+
+// Texels per block of block compressed formats, 1x1 for everything else
+static void formatBlockExtent(VkFormat format, uint32_t* blockWidth, uint32_t* blockHeight)
+{
+	switch (format)
+	{
+	case VK_FORMAT_ASTC_5x4_UNORM_BLOCK: case VK_FORMAT_ASTC_5x4_SRGB_BLOCK: *blockWidth = 5; *blockHeight = 4; return;
+	case VK_FORMAT_ASTC_5x5_UNORM_BLOCK: case VK_FORMAT_ASTC_5x5_SRGB_BLOCK: *blockWidth = 5; *blockHeight = 5; return;
+	case VK_FORMAT_ASTC_6x5_UNORM_BLOCK: case VK_FORMAT_ASTC_6x5_SRGB_BLOCK: *blockWidth = 6; *blockHeight = 5; return;
+	case VK_FORMAT_ASTC_6x6_UNORM_BLOCK: case VK_FORMAT_ASTC_6x6_SRGB_BLOCK: *blockWidth = 6; *blockHeight = 6; return;
+	case VK_FORMAT_ASTC_8x5_UNORM_BLOCK: case VK_FORMAT_ASTC_8x5_SRGB_BLOCK: *blockWidth = 8; *blockHeight = 5; return;
+	case VK_FORMAT_ASTC_8x6_UNORM_BLOCK: case VK_FORMAT_ASTC_8x6_SRGB_BLOCK: *blockWidth = 8; *blockHeight = 6; return;
+	case VK_FORMAT_ASTC_8x8_UNORM_BLOCK: case VK_FORMAT_ASTC_8x8_SRGB_BLOCK: *blockWidth = 8; *blockHeight = 8; return;
+	case VK_FORMAT_ASTC_10x5_UNORM_BLOCK: case VK_FORMAT_ASTC_10x5_SRGB_BLOCK: *blockWidth = 10; *blockHeight = 5; return;
+	case VK_FORMAT_ASTC_10x6_UNORM_BLOCK: case VK_FORMAT_ASTC_10x6_SRGB_BLOCK: *blockWidth = 10; *blockHeight = 6; return;
+	case VK_FORMAT_ASTC_10x8_UNORM_BLOCK: case VK_FORMAT_ASTC_10x8_SRGB_BLOCK: *blockWidth = 10; *blockHeight = 8; return;
+	case VK_FORMAT_ASTC_10x10_UNORM_BLOCK: case VK_FORMAT_ASTC_10x10_SRGB_BLOCK: *blockWidth = 10; *blockHeight = 10; return;
+	case VK_FORMAT_ASTC_12x10_UNORM_BLOCK: case VK_FORMAT_ASTC_12x10_SRGB_BLOCK: *blockWidth = 12; *blockHeight = 10; return;
+	case VK_FORMAT_ASTC_12x12_UNORM_BLOCK: case VK_FORMAT_ASTC_12x12_SRGB_BLOCK: *blockWidth = 12; *blockHeight = 12; return;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: case VK_FORMAT_BC1_RGB_SRGB_BLOCK: case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC2_UNORM_BLOCK: case VK_FORMAT_BC2_SRGB_BLOCK: case VK_FORMAT_BC3_UNORM_BLOCK: case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK: case VK_FORMAT_BC4_SNORM_BLOCK: case VK_FORMAT_BC5_UNORM_BLOCK: case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK: case VK_FORMAT_BC6H_SFLOAT_BLOCK: case VK_FORMAT_BC7_UNORM_BLOCK: case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK: case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK: case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK: case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK: case VK_FORMAT_EAC_R11_SNORM_BLOCK: case VK_FORMAT_EAC_R11G11_UNORM_BLOCK: case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+	case VK_FORMAT_ASTC_4x4_UNORM_BLOCK: case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+		*blockWidth = 4; *blockHeight = 4; return;
+	default:
+		*blockWidth = 1; *blockHeight = 1; return;
+	}
+}
+
+// Bytes per texel block, 0 for formats the loaders don't know the size of
+static uint32_t formatBlockSize(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM: case VK_FORMAT_R8_SRGB:
+		return 1;
+	case VK_FORMAT_R8G8_UNORM: case VK_FORMAT_R8G8_SRGB:
+		return 2;
+	case VK_FORMAT_R8G8B8A8_UNORM: case VK_FORMAT_R8G8B8A8_SRGB: case VK_FORMAT_B8G8R8A8_UNORM: case VK_FORMAT_B8G8R8A8_SRGB:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: case VK_FORMAT_BC1_RGB_SRGB_BLOCK: case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK: case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK: case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK: case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK: case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		return 8;
+	default:
+		// the remaining BC, ETC2 and EAC formats and every ASTC format
+		uint32_t blockWidth, blockHeight;
+		formatBlockExtent(format, &blockWidth, &blockHeight);
+		return blockWidth > 1 ? 16 : 0;
+	}
+}
+
+// Full chain down to 1x1
+static uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1) levels++;
+	return levels;
+}
+
+// Expects level 0 filled and every level in TRANSFER_DST_OPTIMAL, leaves every level in SHADER_READ_ONLY_OPTIMAL
+// Each level is blitted (linear filter) from the one above, which is first moved to TRANSFER_SRC_OPTIMAL. All array layers at once
+// The format must support VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT with optimal tiling
+static void generateMipmaps(VkDevice device, VkQueue queue, VkCommandPool cmdPool, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels,
+	uint32_t layerCount = 1)
+{
+	VkCommandBuffer cmdBuffer = beginCommandBuffer(device, cmdPool);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;									// one level at a time
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = layerCount;
+
+	int32_t mipWidth = static_cast<int32_t>(width);
+	int32_t mipHeight = static_cast<int32_t>(height);
+	for (uint32_t level = 1; level < mipLevels; level++)
+	{
+		// previous level was written (copy or blit), becomes the blit source
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t nextWidth = std::max(mipWidth / 2, 1);
+		int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+		VkImageBlit blit{};
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, layerCount };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, layerCount };
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		vkCmdBlitImage(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		// source level is done
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
+
+	// last level was only written
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
 	endAndSubmitCommandBuffer(device, cmdPool, queue, cmdBuffer);
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// IEEE half with round to nearest even, overflow becomes infinity and tiny values flush to zero
+static uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent == 0xFF) return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);		// inf, nan
+	int halfExponent = static_cast<int>(exponent) - 127 + 15;
+	if (halfExponent >= 31) return sign | 0x7C00;
+	if (halfExponent <= 0)
+	{
+		// subnormal half
+		if (halfExponent < -10) return sign;
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t halfMantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))) halfMantissa++;
+		return sign | static_cast<uint16_t>(halfMantissa);
+	}
+
+	uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;			// may carry into the exponent, which is still correct
+	return sign | static_cast<uint16_t>(half);
+}
+
+uint32_t describeVertexLayout(VertexLayout layout, VertexLayoutAttribute attributes[VERTEX_LAYOUT_ATTRIBUTE_COUNT])
+{
+	if (layout == VertexLayout::Packed || layout == VertexLayout::HalfPosition)
+	{
+		// four component position, three component 16 bit formats are rarely supported for vertex buffers
+		VkFormat positionFormat = layout == VertexLayout::Packed ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R16G16B16A16_SFLOAT;
+		attributes[0] = { 0, positionFormat, offsetof(PackedVertex, position) };
+		attributes[1] = { 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color) };
+		attributes[2] = { 2, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, coordinates) };
+		return sizeof(PackedVertex);
+	}
+
+	attributes[0] = { 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+	attributes[1] = { 1, VK_FORMAT_R32G32B32_SFLOAT, 12 };
+	attributes[2] = { 2, VK_FORMAT_R32G32_SFLOAT, 24 };
+	return static_cast<uint32_t>(FLOAT_VERTEX_SIZE);
+}
+
+uint32_t packVertices(void* vertices, size_t vertexCount, VertexLayout layout, PositionQuantization* quantization)
+{
+	for (size_t k = 0; k < 3; k++)
+	{
+		quantization->scale[k] = 1.0f;
+		quantization->bias[k] = 0.0f;
+	}
+	if (layout == VertexLayout::Float) return static_cast<uint32_t>(FLOAT_VERTEX_SIZE);
+
+	const char* source = static_cast<const char*>(vertices);
+	PackedVertex* packed = static_cast<PackedVertex*>(vertices);
+
+	// -- BOUNDS --
+	// positions map to [-1, 1] around the centre of the bounding box
+	float minimum[3] = { INFINITY, INFINITY, INFINITY };
+	float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const float* position = reinterpret_cast<const float*>(source + v * FLOAT_VERTEX_SIZE);
+		for (size_t k = 0; k < 3; k++)
+		{
+			minimum[k] = std::min(minimum[k], position[k]);
+			maximum[k] = std::max(maximum[k], position[k]);
+		}
+	}
+	for (size_t k = 0; k < 3 && vertexCount > 0; k++)
+	{
+		// half floats keep their own exponent, centring them only keeps the precision away from large offsets
+		float halfExtent = (maximum[k] - minimum[k]) * 0.5f;
+		quantization->scale[k] = halfExtent > 0.0f && layout == VertexLayout::Packed ? halfExtent : 1.0f;		// flat axis, every position is the bias
+		quantization->bias[k] = (maximum[k] + minimum[k]) * 0.5f;
+	}
+
+	// -- PACK --
+	// a packed vertex never reaches past the float vertex it comes from, so converting front to back is safe in place
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		float input[8];
+		memcpy(input, source + v * FLOAT_VERTEX_SIZE, sizeof(input));
+
+		PackedVertex vertex;
+		for (size_t k = 0; k < 3; k++)
+		{
+			if (layout == VertexLayout::HalfPosition)
+			{
+				uint16_t half = floatToHalf(input[k] - quantization->bias[k]);
+				memcpy(&vertex.position[k], &half, sizeof(half));
+			}
+			else
+			{
+				float normalized = std::max(-1.0f, std::min(1.0f, (input[k] - quantization->bias[k]) / quantization->scale[k]));
+				vertex.position[k] = static_cast<int16_t>(std::lround(normalized * 32767.0f));
+			}
+			vertex.color[k] = static_cast<uint8_t>(std::lround(std::max(0.0f, std::min(1.0f, input[3 + k])) * 255.0f));
+		}
+		vertex.position[3] = 0;
+		vertex.color[3] = 255;
+		vertex.coordinates[0] = floatToHalf(input[6]);
+		vertex.coordinates[1] = floatToHalf(input[7]);
+		memcpy(&packed[v], &vertex, sizeof(vertex));
+	}
+	return sizeof(PackedVertex);
+}
+
+VkIndexType packIndices(void* indices, size_t indexCount, size_t vertexCount)
+{
+	if (vertexCount > 65536) return VK_INDEX_TYPE_UINT32;
+
+	// same front to back reasoning as the vertices, primitive restart is never enabled so 0xFFFF is an ordinary index
+	char* stream = static_cast<char*>(indices);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t index;
+		memcpy(&index, stream + i * sizeof(uint32_t), sizeof(index));
+		uint16_t packed = static_cast<uint16_t>(index);
+		memcpy(stream + i * sizeof(uint16_t), &packed, sizeof(packed));
+	}
+	return VK_INDEX_TYPE_UINT16;
+}
+
+uint32_t indexTypeSize(VkIndexType indexType)
+{
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include <vulkan/vulkan.h>
+
+// Vertex and index streams in the layout the GPU reads, shared by the renderer and AssetBaker
+// Input is always the float layout: position xyz, colour rgb, uv as 32 bit floats (Vertex in Utilities.h, BakedVertex in the baker)
+enum class VertexLayout : uint32_t
+{
+	Float = 0,					// 32 bytes, the input as it is
+	Packed = 1,					// 16 bytes: snorm16 position relative to the mesh bounds, unorm8 colour, half float uv
+	HalfPosition = 2			// 16 bytes as Packed, but a half float position relative to the bounds centre, unscaled
+};
+
+struct PackedVertex
+{
+	int16_t position[4];		// w unused, the shaders read xyz. Half float bits in the HalfPosition layout
+	uint8_t color[4];			// alpha 255
+	uint16_t coordinates[2];	// half floats
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must not contain padding");
+
+// Dequantises packed positions: position = stored * scale + bias, folded into the model matrix when drawing
+struct PositionQuantization
+{
+	float scale[3];
+	float bias[3];
+};
+
+struct VertexLayoutAttribute
+{
+	uint32_t location;
+	VkFormat format;
+	uint32_t offset;
+};
+
+const size_t FLOAT_VERTEX_SIZE = 32;
+const uint32_t VERTEX_LAYOUT_ATTRIBUTE_COUNT = 3;
+
+// Attributes for shader locations 0 (position), 1 (colour) and 2 (uv), returns the stride
+uint32_t describeVertexLayout(VertexLayout layout, VertexLayoutAttribute attributes[VERTEX_LAYOUT_ATTRIBUTE_COUNT]);
+
+// Converts float vertices in place, the packed stream starts at the same address. Returns the new stride
+// The quantisation is the identity for the float layout and only a bias for the half position layout
+uint32_t packVertices(void* vertices, size_t vertexCount, VertexLayout layout, PositionQuantization* quantization);
+
+// 32 bit indices become 16 bit in place when every vertex can be addressed with them
+VkIndexType packIndices(void* indices, size_t indexCount, size_t vertexCount);
+uint32_t indexTypeSize(VkIndexType indexType);
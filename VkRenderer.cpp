@@ -1,7 +1,10 @@
 #include "VkRenderer.h"
 
-VkRenderer::VkRenderer(const Window& window) : window(window.GetWindow())
+VkRenderer::VkRenderer(const Window& window, const RendererSettings& settings) : window(window.GetWindow()), settings(settings)
 {
+	vertexShaderFile = settings.deferred ? GBUFFER_VERTEX_SHADER_FILE : VERTEX_SHADER_FILE;
+	fragShaderFile = settings.deferred ? GBUFFER_FRAGMENT_SHADER_FILE : FRAGMENT_SHADER_FILE;
+
 	try 
 	{
 		createInstance();
@@ -9,22 +12,38 @@ VkRenderer::VkRenderer(const Window& window) : window(window.GetWindow())
 		createSurface();
 		getPhysicalDevice();
 		createLogicalDevice();
+		createPipelineCache();
+		createPipelineRegistry();
+		createShaderCompiler();
+		createThreadPool();
+		createStagingBuffer();
+		createShaderWatcher();
 		createSwapChain();
 		createRenderPass();
 		createDescriptorSetLayout();
 		createPushConstantRange();
 		createGraphicsPipeline();
-		createDepthBufferImage();
+		if (settings.deferred) createLightingPipeline();
+		createRenderGraph();
 		createFrameBuffers();
 		createCommandPool();
 		createCommandBuffers();
-		createTextureSampler();
+		createSamplerCache();
 		createUniformBuffers();
 		createDescriptorPool();
 		createDescriptorSets();
 		createSynchronization();
+		createTimestampQueryPool();
 
 		uboVP = UboViewProjection((float)swapChainExtent.width, (float)swapChainExtent.height);
+		setLights
+		(
+			{
+				{ glm::vec4(-1.5f, 1.0f, -2.0f, 4.0f), glm::vec4(1.0f, 0.6f, 0.3f, 1.5f) },
+				{ glm::vec4(1.5f, -1.0f, -2.0f, 4.0f), glm::vec4(0.3f, 0.6f, 1.0f, 1.5f) }
+			},
+			glm::vec3(0.1f)
+		);
 		createMesh();
 	}
 	catch (const std::runtime_error& e) {
@@ -36,13 +55,48 @@ void VkRenderer::updateModel(size_t modelId, glm::mat4 newModel)
 	if (modelId >= meshes.size()) return;
 	meshes[modelId]->setModel(newModel);
 }
+void VkRenderer::setModelTransform(size_t modelId, glm::mat4 newModel)
+{
+	if (modelId >= models.size()) return;
+	models[modelId].setModel(newModel);
+}
+void VkRenderer::setLights(const std::vector<Light>& lights, glm::vec3 ambient)
+{
+	uboLights.ambient = glm::vec4(ambient, 1.0f);
+	uboLights.lightCount = static_cast<uint32_t>(std::min(lights.size(), MAX_LIGHTS));
+	std::copy(lights.begin(), lights.begin() + uboLights.lightCount, uboLights.lights);
+}
+void VkRenderer::setMeshFeatures(size_t meshId, PipelineFeatures features)
+{
+	if (meshId >= meshes.size()) return;
+	meshes[meshId]->setFeatures(features);
+	getGraphicsPipeline(features);				// build the variant now rather than while recording
+}
 VkRenderer::~VkRenderer()
 {
+	// stop watching and let a running rebuild finish, its pipelines are destroyed with the rest
+	delete shaderWatcher;
+	if (shaderReload.valid())
+	{
+		try
+		{
+			applyShaderReload(shaderReload.get());
+		}
+		catch (const std::runtime_error&) {}
+	}
+
 	vkDeviceWaitIdle(device.logical);
+	for (const RetiredPipeline& retired : retiredPipelines)
+	{
+		vkDestroyPipeline(device.logical, retired.pipeline, nullptr);
+	}
+	for (PipelineFeatures features : staleVariants)
+	{
+		vkDestroyPipeline(device.logical, graphicsPipelines[features], nullptr);
+	}
 
 	vkDestroyDescriptorPool(device.logical, samplerDescriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(device.logical, samplerSetLayout, nullptr);
-	vkDestroySampler(device.logical, textureSampler, nullptr);
+	delete samplerCache;
 	for (size_t i = 0; i < textureImages.size(); i++)
 	{
 		vkDestroyImageView(device.logical, textureImageViews[i], nullptr);
@@ -50,17 +104,25 @@ VkRenderer::~VkRenderer()
 		vkFreeMemory(device.logical, textureImageMemory[i], nullptr);
 	}
 
-	vkDestroyImageView(device.logical, depthBufferImageView, nullptr);
-	vkDestroyImage(device.logical, depthBufferImage, nullptr);
-	vkFreeMemory(device.logical, depthBufferImageMemory, nullptr);
+	delete renderGraph;
 
 	vkDestroyDescriptorPool(device.logical, descriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(device.logical, descriptorSetLayout, nullptr);
 	for (size_t i = 0; i < swapChainImages.size(); i++)
 	{
 		vkDestroyBuffer(device.logical, vpUniformBuffer[i], nullptr);
 		vkFreeMemory(device.logical, vpUniformBufferMemory[i], nullptr);
 	}
+	if (settings.deferred)
+	{
+		vkDestroyDescriptorPool(device.logical, lightingDescriptorPool, nullptr);
+		for (size_t i = 0; i < lightUniformBuffer.size(); i++)
+		{
+			vkDestroyBuffer(device.logical, lightUniformBuffer[i], nullptr);
+			vkFreeMemory(device.logical, lightUniformBufferMemory[i], nullptr);
+		}
+		vkDestroyShaderModule(device.logical, lightingFragModule, nullptr);
+		vkDestroyShaderModule(device.logical, lightingVertexModule, nullptr);
+	}
 	for (const Mesh* mesh : meshes)
 	{
 		delete mesh;
@@ -69,15 +131,41 @@ VkRenderer::~VkRenderer()
 	{
 		vkDestroySemaphore(device.logical, renderSemaphores[i], nullptr);
 		vkDestroySemaphore(device.logical, imageSemaphores[i], nullptr);
+		vkDestroySemaphore(device.logical, computeSemaphores[i], nullptr);
 		vkDestroyFence(device.logical, drawFences[i], nullptr);
 	}
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(device.logical, timestampQueryPool, nullptr);
+	}
+	vkDestroyCommandPool(device.logical, computeCommandPool, nullptr);
 	vkDestroyCommandPool(device.logical, graphicsCommandPool, nullptr);
+	for (const ComputePipeline& computePipeline : computePipelines)
+	{
+		vkDestroyPipeline(device.logical, computePipeline.pipeline, nullptr);
+	}
 	for (auto frameBuffer : swapChainFramebuffers)
 	{
 		vkDestroyFramebuffer(device.logical, frameBuffer, nullptr);
 	}
-	vkDestroyPipeline(device.logical, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device.logical, pipelineLayout, nullptr);
+	delete pipelineRegistry;
+	vkDestroyShaderModule(device.logical, fragShaderModule, nullptr);
+	vkDestroyShaderModule(device.logical, vertexShaderModule, nullptr);
+	delete layoutCache;
+	if (pipelineCache != nullptr)
+	{
+		try
+		{
+			pipelineCache->save();
+		}
+		catch (const std::runtime_error& e) {
+			printf("ERROR: %s\n", e.what());
+		}
+		delete pipelineCache;
+	}
+	delete shaderCompiler;
+	delete threadPool;
+	delete stagingBuffer;
 	vkDestroyRenderPass(device.logical, renderPass, nullptr);
 	for (const SwapChainImage& image : swapChainImages)
 	{
@@ -98,6 +186,8 @@ void VkRenderer::draw()
 	// 2. Submit cmd buffer to queue for execution, need to wait image availability and signal when it's finished
 	// 3. Present image to screen when rendering ready
 
+	auto blockStart = std::chrono::steady_clock::now();
+
 	// -- STOP FOR FENCES -- 
 	// wait for given fence to signal (open) from last draw before continuing CPU code, after that unsignal it (close)
 	vkWaitForFences(device.logical, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());		
@@ -107,19 +197,48 @@ void VkRenderer::draw()
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(device.logical, swapchain, std::numeric_limits<uint64_t>::max(), imageSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
+	auto blockEnd = std::chrono::steady_clock::now();
+	frameTimings.drawBlockedMs = std::chrono::duration<double, std::milli>(blockEnd - blockStart).count();
+
+	// fence is open, so the queries this frame slot wrote last time are complete
+	readTimestamps();
+
+	// frame boundary: swap in rebuilt pipelines before anything is recorded
+	updateShaderReload();
+
+	// -- SUBMIT COMPUTE WORK --
+	// compute queue signals a semaphore the graphics submission waits on, only the stages consuming compute output stall
+	bool hasCompute = !computeDispatches.empty();
+	if (hasCompute)
+	{
+		recordComputeCommands();
+
+		VkSubmitInfo computeSubmitInfo = {};
+		computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		computeSubmitInfo.commandBufferCount = 1;
+		computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
+		computeSubmitInfo.signalSemaphoreCount = 1;
+		computeSubmitInfo.pSignalSemaphores = &computeSemaphores[currentFrame];
+
+		VkResult result = vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE);
+		checkResult(result, "Failed to submit compute cmd buffer to queue");
+	}
+
 	recordCommands(imageIndex);
 	updateUniformBuffers(imageIndex);
 
 	// -- SUBMIT CMD BUFFER TO RENDER --
+	std::array<VkSemaphore, 2> waitSemaphores = { imageSemaphores[currentFrame], computeSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] =
 	{
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
 	};
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;								
-	submitInfo.pWaitSemaphores = &imageSemaphores[currentFrame];				
+	submitInfo.waitSemaphoreCount = hasCompute ? 2 : 1;
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
 	submitInfo.pWaitDstStageMask = waitStages;													// Stages when to check semaphor, in our case we wait when we reach the color attachment
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];									// cmd buffer to submit, since in the chain we have 1 to 1 relation it's at img index
@@ -142,6 +261,7 @@ void VkRenderer::draw()
 	checkResult(result, "Failed to present image to screen");
 
 	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
+	frameNumber++;
 }
 
 void VkRenderer::createInstance()
@@ -236,16 +356,17 @@ void VkRenderer::createLogicalDevice()
 
 	// Vector for queue creation information, and set for family indices
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily, indices.computeFamily };
 
 	// Queues the logical device needs to create and info to do so
+	// priority must outlive the loop, vkCreateDevice reads it through every create info
+	float priority = 1.0f;
 	for (int queueFamilyIndex : queueFamilyIndices)
 	{
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;						// The index of the family to create a queue from
 		queueCreateInfo.queueCount = 1;												// Number of queues to create
-		float priority = 1.0f;
 		queueCreateInfo.pQueuePriorities = &priority;								// Vulkan needs to know how to handle multiple queues, so decide priority (1 = highest priority)
 
 		queueCreateInfos.push_back(queueCreateInfo);
@@ -255,14 +376,42 @@ void VkRenderer::createLogicalDevice()
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	// Compressed texture families are optional, KTX2 textures are checked against the enabled formats when loaded
+	VkPhysicalDeviceFeatures supportedFeatures = {};
+	vkGetPhysicalDeviceFeatures(device.physical, &supportedFeatures);
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	deviceFeatures.textureCompressionETC2 = supportedFeatures.textureCompressionETC2;
+	deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+
+
+	// Required extensions plus whichever optional ones the device has
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device.physical, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device.physical, nullptr, &extensionCount, extensions.data());
+
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	for (const char* optionalExtension : optionalDeviceExtensions)
+	{
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(optionalExtension, extension.extensionName) == 0)
+			{
+				enabledExtensions.push_back(optionalExtension);
+				break;
+			}
+		}
+	}
+	pipelineFeedbackEnabled = std::find_if(enabledExtensions.begin(), enabledExtensions.end(),
+		[](const char* name) { return strcmp(name, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0; }) != enabledExtensions.end();
 
 	// Information to create logical device (sometimes called "device")
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());		// Number of Queue Create Infos
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();								// List of queue create infos so device can create required queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());	// Number of enabled logical device extensions
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();							// List of enabled logical device extensions
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());	// Number of enabled logical device extensions
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();						// List of enabled logical device extensions
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;										// Physical Device features Logical Device will use
 
 	// Create the logical device for the given physical device
@@ -275,6 +424,39 @@ void VkRenderer::createLogicalDevice()
 	// From given logical device, of given Queue Family, of given Queue Index (0 since only one queue), place reference in given VkQueue
 	vkGetDeviceQueue(device.logical, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(device.logical, indices.presentationFamily, 0, &presentationQueue);
+	vkGetDeviceQueue(device.logical, indices.computeFamily, 0, &computeQueue);
+
+	queueFamilies = indices;
+}
+
+void VkRenderer::createPipelineCache()
+{
+	pipelineCache = new PipelineCache(device, PIPELINE_CACHE_FILE);
+}
+
+void VkRenderer::createPipelineRegistry()
+{
+	pipelineRegistry = new PipelineRegistry(device);
+}
+
+void VkRenderer::createShaderCompiler()
+{
+	shaderCompiler = new ShaderCompiler(SHADER_CACHE_DIRECTORY);
+}
+
+void VkRenderer::createThreadPool()
+{
+	threadPool = new ThreadPool();
+}
+
+void VkRenderer::createStagingBuffer()
+{
+	stagingBuffer = new StagingBuffer(device, STAGING_BUFFER_SIZE);
+}
+
+void VkRenderer::createShaderWatcher()
+{
+	shaderWatcher = new ShaderWatcher(SHADER_DIRECTORY);
 }
 
 void VkRenderer::createSurface()
@@ -366,19 +548,23 @@ void VkRenderer::createSwapChain()
 
 void VkRenderer::createRenderPass()
 {
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
 	//-- ATTACHMENTS
 	// Color attachment of RenderPass
+	// with MSAA it is the resolve target: every pixel gets overwritten at the end of the subpass, same for the deferred lighting
 	VkAttachmentDescription colorAttachment = {};
 	colorAttachment.format = swapChainImageFormat;
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.loadOp = settings.deferred || multisampled ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
 	// Framebffer data will be stored as an image, but images can be given different data layout
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// the render graph transitions into and out of the pass, so the layout stays the same throughout
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	//Depth attachment of render pass
 	VkAttachmentDescription depthAttachment = {};
@@ -386,12 +572,12 @@ void VkRenderer::createRenderPass()
 		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.samples = msaaSamples;		// only tested against, never resolved
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	//--REFERENCES
@@ -405,44 +591,99 @@ void VkRenderer::createRenderPass()
 	depthAttachmentReference.attachment = 1;
 	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentReference;
-	subpass.pDepthStencilAttachment = &depthAttachmentReference;
-
-	//Need to determin when layout transitions occur using subpass dependencies
-	std::array<VkSubpassDependency, 2> subpassDependencies;
-	//conversion from LAYOUT UNDEFINED to LAYOUT COLOR ATTACHMENT OPTIMAL
-	// transition must happpen after...
-	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	// but mast happen before...
-	subpassDependencies[0].dstSubpass = 0;
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	subpassDependencies[0].dependencyFlags = 0;
-
-	subpassDependencies[1].srcSubpass = 0;
-	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	subpassDependencies[1].dependencyFlags = 0;
-
-	std::array<VkAttachmentDescription, 2> renderPassAttachments = { colorAttachment, depthAttachment };
+	std::vector<VkAttachmentDescription> renderPassAttachments = { colorAttachment, depthAttachment };
+	std::vector<VkSubpassDescription> subpasses;
+	std::vector<VkSubpassDependency> dependencies;
+
+	//-- MSAA
+	// Subpass renders into a multisampled attachment that never leaves tile memory, the resolve into the swapchain image happens as the subpass ends
+	VkAttachmentReference msaaColorReference = {};
+	if (multisampled)
+	{
+		VkAttachmentDescription msaaColorAttachment = colorAttachment;
+		msaaColorAttachment.samples = msaaSamples;
+		msaaColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		msaaColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		renderPassAttachments.push_back(msaaColorAttachment);
+
+		msaaColorReference.attachment = static_cast<uint32_t>(renderPassAttachments.size() - 1);
+		msaaColorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	if (!settings.deferred)
+	{
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = multisampled ? &msaaColorReference : &colorAttachmentReference;
+		subpass.pResolveAttachments = multisampled ? &colorAttachmentReference : nullptr;
+		subpass.pDepthStencilAttachment = &depthAttachmentReference;
+		subpasses.push_back(subpass);
+	}
+
+	//-- DEFERRED
+	// Subpass 0 fills the G-buffer, subpass 1 reads it back as input attachments and lights into the swapchain image
+	// G-buffer contents never leave the render pass: cleared on load, not stored, so a tiler keeps them in tile memory
+	std::array<VkAttachmentReference, GBUFFER_FORMATS.size()> gbufferReferences;
+	std::array<VkAttachmentReference, GBUFFER_FORMATS.size()> inputReferences;
+	if (settings.deferred)
+	{
+		for (size_t i = 0; i < GBUFFER_FORMATS.size(); i++)
+		{
+			VkAttachmentDescription gbufferAttachment = {};
+			gbufferAttachment.format = GBUFFER_FORMATS[i];
+			gbufferAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			gbufferAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			gbufferAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			gbufferAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			gbufferAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			gbufferAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			gbufferAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			renderPassAttachments.push_back(gbufferAttachment);
+
+			uint32_t attachment = static_cast<uint32_t>(renderPassAttachments.size() - 1);
+			gbufferReferences[i] = { attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			inputReferences[i] = { attachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		}
+
+		VkSubpassDescription gbufferSubpass = {};
+		gbufferSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		gbufferSubpass.colorAttachmentCount = static_cast<uint32_t>(gbufferReferences.size());
+		gbufferSubpass.pColorAttachments = gbufferReferences.data();
+		gbufferSubpass.pDepthStencilAttachment = &depthAttachmentReference;
+		subpasses.push_back(gbufferSubpass);
+
+		VkSubpassDescription lightingSubpass = {};
+		lightingSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		lightingSubpass.colorAttachmentCount = 1;
+		lightingSubpass.pColorAttachments = &colorAttachmentReference;
+		lightingSubpass.inputAttachmentCount = static_cast<uint32_t>(inputReferences.size());
+		lightingSubpass.pInputAttachments = inputReferences.data();
+		subpasses.push_back(lightingSubpass);
+
+		// by region: each pixel only reads what the previous subpass wrote at the same pixel, no full flush between them
+		VkSubpassDependency gbufferToLighting = {};
+		gbufferToLighting.srcSubpass = 0;
+		gbufferToLighting.dstSubpass = 1;
+		gbufferToLighting.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		gbufferToLighting.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		gbufferToLighting.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		gbufferToLighting.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		gbufferToLighting.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		dependencies.push_back(gbufferToLighting);
+	}
+
+	// No external subpass dependencies, the render graph records the barriers before and after the pass
+
 	//Create info for render pass
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = static_cast<uint32_t>(renderPassAttachments.size());
 	renderPassInfo.pAttachments = renderPassAttachments.data();
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
-	renderPassInfo.pDependencies = subpassDependencies.data();
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassInfo.pSubpasses = subpasses.data();
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	VkResult result = vkCreateRenderPass(device.logical, &renderPassInfo, nullptr, &renderPass);
 	checkResult(result, "Faield to create a render pass");
@@ -451,56 +692,171 @@ void VkRenderer::createRenderPass()
 
 void VkRenderer::createDescriptorSetLayout()
 {
-	//-- UNIFORM 
-	// UboViewProjection Binding Info
-	VkDescriptorSetLayoutBinding vpLayoutBinding = {};
-	vpLayoutBinding.binding = 0;											// Binding point in shader (designated by binding number in shader)
-	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor (uniform, dynamic uniform, image sampler, etc)
-	vpLayoutBinding.descriptorCount = 1;									// Number of descriptors for binding
-	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Shader stage to bind to
-	vpLayoutBinding.pImmutableSamplers = nullptr;							// For Texture: Can make sampler data unchangeable (immutable) by specifying in layout
+	layoutCache = new DescriptorLayoutCache(device);
 
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpLayoutBinding };
+	// bindings, push constants and vertex inputs come from the shaders, the code below only checks what it relies on
+	ShaderReflection vertexReflection(loadSpirv(vertexShaderFile));
+	ShaderReflection fragReflection(loadSpirv(fragShaderFile));
+	graphicsLayout = ShaderReflection::mergeLayouts({ &vertexReflection, &fragReflection });
 
-	// Create Descriptor Set Layout with given bindings
-	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
-	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());	// Number of binding infos
-	layoutCreateInfo.pBindings = layoutBindings.data();
-
-	VkResult result = vkCreateDescriptorSetLayout(device.logical, &layoutCreateInfo, nullptr, &descriptorSetLayout);
-	checkResult(result, "Failed to create descriptor set layout");
+	// SET 0: UboViewProjection, SET 1: texture sampler (one set per texture)
+	if (graphicsLayout.sets.size() != 2)
+	{
+		throw std::runtime_error("Graphics shaders must use descriptor set 0 (view projection) and 1 (texture)!");
+	}
+	descriptorSetLayout = layoutCache->getSetLayout(graphicsLayout.sets[0]);
+	samplerSetLayout = layoutCache->getSetLayout(graphicsLayout.sets[1]);
 
-	//-- SAMPLER
-	//this is now SET 1 BINDING 0, earleir it was SET 0 BINDING 0 
-	VkDescriptorSetLayoutBinding textureLayoutBinding{};
-	textureLayoutBinding.binding = 0;
-	textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	textureLayoutBinding.descriptorCount = 1;
-	textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	textureLayoutBinding.pImmutableSamplers = nullptr;
+	// -- VERTEX INPUT --
+	vertexAttributes = createVertexInput(vertexReflection, &vertexStride);
+}
 
-	VkDescriptorSetLayoutCreateInfo textureLayoutInfo{};
-	textureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	textureLayoutInfo.bindingCount = 1;
-	textureLayoutInfo.pBindings = &textureLayoutBinding;
+std::vector<VkVertexInputAttributeDescription> VkRenderer::createVertexInput(const ShaderReflection& reflection, uint32_t* stride)
+{
+	// attributes are packed in location order, which has to be the member order of Vertex
+	std::vector<VkVertexInputAttributeDescription> attributes = reflection.createVertexAttributes(0, stride);
+	if (*stride != sizeof(Vertex) || attributes.size() != VERTEX_LAYOUT_ATTRIBUTE_COUNT)
+	{
+		throw std::runtime_error("Vertex shader inputs don't match the Vertex struct!");
+	}
 
-	result = vkCreateDescriptorSetLayout(device.logical, &textureLayoutInfo, nullptr, &samplerSetLayout);
-	checkResult(result, "Failed to create descriptor set layout");
+	// the shaders keep reading floats, normalized and half formats are converted by the input assembler
+	VertexLayoutAttribute layoutAttributes[VERTEX_LAYOUT_ATTRIBUTE_COUNT];
+	*stride = describeVertexLayout(settings.vertexLayout, layoutAttributes);
+	for (VkVertexInputAttributeDescription& attribute : attributes)
+	{
+		if (attribute.location >= VERTEX_LAYOUT_ATTRIBUTE_COUNT)
+		{
+			throw std::runtime_error("Vertex shader inputs don't match the Vertex struct!");
+		}
+		attribute.format = layoutAttributes[attribute.location].format;
+		attribute.offset = layoutAttributes[attribute.location].offset;
+	}
+	return attributes;
 }
 
 void VkRenderer::createPushConstantRange()
 {
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(glm::mat4);
+	pushConstantRange = graphicsLayout.pushConstantRange;
+	if (pushConstantRange.offset != 0 || pushConstantRange.size < sizeof(glm::mat4))
+	{
+		throw std::runtime_error("Graphics shaders must take the model matrix as push constant!");
+	}
 }
 
 void VkRenderer::createGraphicsPipeline()
 {
-	// Build Shader Module to link to Grapphics Pipeline
-	VkShaderModule vertexShaderModule = createShaderModule("Shaders/vert.spv");
-	VkShaderModule fragShaderModule = createShaderModule("Shaders/frag.spv");
+	// Build Shader Module to link to Grapphics Pipeline, kept alive so variants can be built later
+	vertexShaderModule = createShaderModule(vertexShaderFile);
+	fragShaderModule = createShaderModule(fragShaderFile);
+
+	// -- PIPELINE LAYOUT --
+	// shared by all variants, features only change shader code
+	pipelineLayout = layoutCache->getPipelineLayout({ descriptorSetLayout, samplerSetLayout }, { pushConstantRange });
+
+	// every feature combination up front, spread over the worker threads
+	std::vector<PipelineFeatures> variants;
+	for (PipelineFeatures features = 0; features < (1u << PIPELINE_FEATURE_COUNT); features++)
+	{
+		variants.push_back(features);
+	}
+	buildGraphicsPipelines(variants);
+}
+
+void VkRenderer::buildGraphicsPipelines(const std::vector<PipelineFeatures>& variants)
+{
+	std::vector<PipelineFeatures> missing;
+	for (PipelineFeatures features : variants)
+	{
+		if (graphicsPipelines.find(features) == graphicsPipelines.end() && std::find(missing.begin(), missing.end(), features) == missing.end())
+		{
+			missing.push_back(features);
+		}
+	}
+	if (missing.empty()) return;
+
+	// one batch per worker, each batch is a single vkCreateGraphicsPipelines call into the worker's own cache, seeded from the one loaded from disk
+	size_t batchCount = std::min(threadPool->getThreadCount(), missing.size());
+	size_t batchSize = (missing.size() + batchCount - 1) / batchCount;
+
+	auto buildStart = std::chrono::steady_clock::now();
+	std::vector<std::future<std::vector<PipelineBuildResult>>> batches;
+	for (size_t first = 0; first < missing.size(); first += batchSize)
+	{
+		std::vector<PipelineFeatures> batch(missing.begin() + first, missing.begin() + std::min(first + batchSize, missing.size()));
+		batches.push_back(threadPool->submit([this, batch]()
+		{
+			return createGraphicsPipelineVariants(batch, vertexShaderModule, fragShaderModule, pipelineCache->createWorkerCache());
+		}));
+	}
+
+	// collect every batch before rethrowing, so no pipeline built by a successful batch leaks
+	std::exception_ptr error;
+	for (auto& batch : batches)
+	{
+		try
+		{
+			for (const PipelineBuildResult& built : batch.get())
+			{
+				graphicsPipelines[built.features] = built.pipeline;
+				printf("Graphics pipeline variant 0x%x built in %.2f ms%s\n", built.features, built.buildMs, built.registryHit ? " (registry hit)" :
+					pipelineFeedbackEnabled ? (built.cacheHit ? " (cache hit)" : " (cache miss)") : " (batch average)");
+			}
+		}
+		catch (...)
+		{
+			error = error ? error : std::current_exception();
+		}
+	}
+	pipelineCache->mergeWorkerCaches();
+	if (error) std::rethrow_exception(error);
+
+	printf("Built %zu graphics pipelines in %zu batches on %zu threads in %.2f ms\n", missing.size(), batches.size(), threadPool->getThreadCount(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count());
+	printf("Pipeline registry: %zu pipelines, %.1f%% hit rate (%zu of %zu requests)\n", pipelineRegistry->getPipelineCount(),
+		pipelineRegistry->getHitRate() * 100.0, pipelineRegistry->getHitCount(), pipelineRegistry->getRequestCount());
+}
+
+VkPipeline VkRenderer::getGraphicsPipeline(PipelineFeatures features)
+{
+	auto variant = graphicsPipelines.find(features);
+	if (variant != graphicsPipelines.end())
+	{
+		return variant->second;
+	}
+
+	VkPipeline pipeline = createGraphicsPipelineVariants({ features }, vertexShaderModule, fragShaderModule, pipelineCache->getCache())[0].pipeline;
+	graphicsPipelines[features] = pipeline;
+	return pipeline;
+}
+
+std::vector<PipelineBuildResult> VkRenderer::createGraphicsPipelineVariants(const std::vector<PipelineFeatures>& variants,
+	VkShaderModule vertexModule, VkShaderModule fragModule, VkPipelineCache cache)
+{
+	// -- SPECIALIZATION --
+	// one VkBool32 per feature bit, the driver strips the code of disabled features
+	std::array<VkSpecializationMapEntry, PIPELINE_FEATURE_COUNT> specializationEntries;
+	for (uint32_t i = 0; i < PIPELINE_FEATURE_COUNT; i++)
+	{
+		specializationEntries[i].constantID = i;
+		specializationEntries[i].offset = i * sizeof(VkBool32);
+		specializationEntries[i].size = sizeof(VkBool32);
+	}
+
+	std::vector<std::array<VkBool32, PIPELINE_FEATURE_COUNT>> featureConstants(variants.size());
+	std::vector<VkSpecializationInfo> specializationInfos(variants.size());
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		for (uint32_t i = 0; i < PIPELINE_FEATURE_COUNT; i++)
+		{
+			featureConstants[v][i] = (variants[v] & (1u << i)) ? VK_TRUE : VK_FALSE;
+		}
+		specializationInfos[v] = {};
+		specializationInfos[v].mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+		specializationInfos[v].pMapEntries = specializationEntries.data();
+		specializationInfos[v].dataSize = sizeof(featureConstants[v]);
+		specializationInfos[v].pData = featureConstants[v].data();
+	}
 
 	// -- SHADER STAGE  --
 
@@ -508,50 +864,39 @@ void VkRenderer::createGraphicsPipeline()
 	VkPipelineShaderStageCreateInfo vertexInfo = {};
 	vertexInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertexInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertexInfo.module = vertexShaderModule;
+	vertexInfo.module = vertexModule;
 	vertexInfo.pName = "main";		//can custom the main name of the shaders to be run,
 
 	// Fragment stage creation information
 	VkPipelineShaderStageCreateInfo fragInfo = {};
 	fragInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragInfo.module = fragShaderModule;
+	fragInfo.module = fragModule;
 	fragInfo.pName = "main";
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexInfo, fragInfo };
+	// same modules for every variant, only the specialization data differs
+	std::vector<std::array<VkPipelineShaderStageCreateInfo, 2>> shaderStages(variants.size());
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		shaderStages[v] = { vertexInfo, fragInfo };
+		shaderStages[v][0].pSpecializationInfo = &specializationInfos[v];
+		shaderStages[v][1].pSpecializationInfo = &specializationInfos[v];
+	}
 
 	// -- VERTEX INPUT DATA -- 
 	VkVertexInputBindingDescription bindingDescription = {};
 	bindingDescription.binding = 0;														// can bind multiple streams of data
-	bindingDescription.stride = sizeof(Vertex);											// size of a signel vertex object
+	bindingDescription.stride = vertexStride;											// size of a signel vertex object
 	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;							// how to move between data after each vertex. there is _INSTANCE too to instance multiple objects that are the same
 
 
-	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions;
-	//position attributes
-	attributeDescriptions[0].binding = 0;												// which binding the data is at (in shad.frag layout(binding = 0) is implicit
-	attributeDescriptions[0].location = 0;												// layout shader location
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[0].offset = offsetof(Vertex, position);						// where this attribute is defined in the data of a singel vertex
-
-	//color attributes
-	attributeDescriptions[1].binding = 0;
-	attributeDescriptions[1].location = 1;
-	attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-	//uv coordinates attributes
-	attributeDescriptions[2].binding = 0;
-	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Vertex, coordinates);
-
+	// attributes reflected from the vertex shader (createDescriptorSetLayout)
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputInfo.vertexBindingDescriptionCount = 1;
 	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
 
 	// -- INPUT ASSEMBLY --
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
@@ -610,7 +955,7 @@ void VkRenderer::createGraphicsPipeline()
 	VkPipelineMultisampleStateCreateInfo multisampling = {};
 	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.rasterizationSamples = msaaSamples;				// must match the subpass attachments
 
 	// -- COLOR ATTACHMENTS --
 	//(how blending is handled)
@@ -628,26 +973,20 @@ void VkRenderer::createGraphicsPipeline()
 	colorAttachmentInfo.alphaBlendOp = VK_BLEND_OP_ADD;
 	//Summarised: (1 * newAlpha) + (0 * oldAlpha) = newAlpha
 
+	// G-buffer attachments hold data rather than colour, they are overwritten
+	std::vector<VkPipelineColorBlendAttachmentState> colorAttachmentInfos(1, colorAttachmentInfo);
+	if (settings.deferred)
+	{
+		colorAttachmentInfo.blendEnable = VK_FALSE;
+		colorAttachmentInfos.assign(GBUFFER_FORMATS.size(), colorAttachmentInfo);
+	}
+
 	// -- BLENDING --
 	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
 	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlendInfo.logicOpEnable = VK_FALSE;
-	colorBlendInfo.attachmentCount = 1;
-	colorBlendInfo.pAttachments = &colorAttachmentInfo;
-
-	// -- PIPELINE LAYOUT --
-	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { descriptorSetLayout, samplerSetLayout};
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo= {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-	pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = 1;
-	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-	//Create layout
-	VkResult result = vkCreatePipelineLayout(device.logical, &pipelineLayoutInfo, nullptr, &pipelineLayout);
-	checkResult(result, "Failed to create pipeline layout");
-
+	colorBlendInfo.attachmentCount = static_cast<uint32_t>(colorAttachmentInfos.size());
+	colorBlendInfo.pAttachments = colorAttachmentInfos.data();
 
 	// -- DEPTH STENCIL TEST --
 	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
@@ -662,7 +1001,6 @@ void VkRenderer::createGraphicsPipeline()
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.stageCount = 2;									// Number of shader stages
-	pipelineInfo.pStages = shaderStages;							// List of shader stages
 	pipelineInfo.pVertexInputState = &vertexInputInfo;		// All the fixed function pipeline states
 	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
 	pipelineInfo.pViewportState = &viewportStateInfo;
@@ -679,95 +1017,344 @@ void VkRenderer::createGraphicsPipeline()
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;				// existing pippelien to derive from...
 	pipelineInfo.basePipelineIndex = -1;							// or index of pipeline being created to derive from ( if created multiple )
 
-	result = vkCreateGraphicsPipelines(device.logical, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline);
-	checkResult(result,"Failed to create a pipeline");
-
-	// -- DESTROY --
-	vkDestroyShaderModule(device.logical, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device.logical, vertexShaderModule, nullptr);
-}
-
-void VkRenderer::createDepthBufferImage()
-{
-	// get supported format
-	VkFormat depthBufferFormat = chooseSupportedFormat
-	(
-		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-	);
-
-	// create depth buffer image
-	depthBufferImage = createImage
-	(
-		swapChainExtent.width, swapChainExtent.height, 
-		depthBufferFormat,
-		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory
-	);
+	// one create info per variant, with creation feedback chained when the device reports it
+	std::vector<VkGraphicsPipelineCreateInfo> pipelineInfos(variants.size(), pipelineInfo);
+	std::vector<VkPipelineCreationFeedbackEXT> feedbacks(variants.size());
+	std::vector<VkPipelineCreationFeedbackCreateInfoEXT> feedbackInfos(variants.size());
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		pipelineInfos[v].pStages = shaderStages[v].data();				// List of shader stages
 
-	// create depth buffer image view
-	depthBufferImageView = createImageView(depthBufferImage, depthBufferFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-}
+		if (pipelineFeedbackEnabled)
+		{
+			feedbackInfos[v] = {};
+			feedbackInfos[v].sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+			feedbackInfos[v].pPipelineCreationFeedback = &feedbacks[v];
+			pipelineInfos[v].pNext = &feedbackInfos[v];
+		}
+	}
 
-void VkRenderer::createFrameBuffers()
-{
-	swapChainFramebuffers.resize(swapChainImages.size());
-	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+	// -- REGISTRY LOOKUP --
+	// state that was built before is handed out again, only the rest goes to the driver
+	std::vector<uint64_t> stateHashes(variants.size());
+	std::vector<VkPipeline> pipelines(variants.size());
+	std::vector<VkGraphicsPipelineCreateInfo> missingInfos;
+	std::vector<size_t> missingVariants;
+	for (size_t v = 0; v < variants.size(); v++)
 	{
-		std::array<VkImageView, 2> attachments =
+		stateHashes[v] = PipelineRegistry::hashState(pipelineInfos[v]);
+		pipelines[v] = pipelineRegistry->find(stateHashes[v]);
+		if (pipelines[v] == VK_NULL_HANDLE)
 		{
-			swapChainImages[i].imageView,
-			depthBufferImageView
-		};
-
+			missingInfos.push_back(pipelineInfos[v]);
+			missingVariants.push_back(v);
+		}
+	}
 
-		VkFramebufferCreateInfo frameBufferInfo = {};		
-		frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		frameBufferInfo.renderPass = renderPass;											// render pass layout the framebuffei will be used ith
-		frameBufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());		
-		frameBufferInfo.pAttachments = attachments.data();									// list of attachmetns 1 to 1 with render pass
-		frameBufferInfo.width = swapChainExtent.width;										
-		frameBufferInfo.height = swapChainExtent.height;
-		frameBufferInfo.layers = 1;
+	double batchMs = 0.0;
+	if (!missingInfos.empty())
+	{
+		std::vector<VkPipeline> built(missingInfos.size());
+		auto buildStart = std::chrono::steady_clock::now();
+		VkResult result = vkCreateGraphicsPipelines(device.logical, cache, static_cast<uint32_t>(missingInfos.size()), missingInfos.data(), nullptr, built.data());
+		batchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+		if (result != VK_SUCCESS)
+		{
+			// entries that did get built are valid handles, the others are VK_NULL_HANDLE
+			for (VkPipeline pipeline : built)
+			{
+				if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device.logical, pipeline, nullptr);
+			}
+			checkResult(result, "Failed to create a pipeline");
+		}
 
-		VkResult result = vkCreateFramebuffer(device.logical, &frameBufferInfo, nullptr, &swapChainFramebuffers[i]);
-		checkResult(result, "Failed to create a frame buffer");
+		for (size_t i = 0; i < built.size(); i++)
+		{
+			size_t v = missingVariants[i];
+			pipelines[v] = pipelineRegistry->insert(stateHashes[v], built[i]);
+		}
+	}
 
+	std::vector<PipelineBuildResult> results(variants.size());
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		bool registryHit = std::find(missingVariants.begin(), missingVariants.end(), v) == missingVariants.end();
+		bool feedbackValid = !registryHit && pipelineFeedbackEnabled && (feedbacks[v].flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT);
+		results[v].features = variants[v];
+		results[v].pipeline = pipelines[v];
+		results[v].buildMs = registryHit ? 0.0 : feedbackValid ? feedbacks[v].duration / 1000000.0 : batchMs / missingInfos.size();
+		results[v].cacheHit = feedbackValid && (feedbacks[v].flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT);
+		results[v].registryHit = registryHit;
 	}
+	return results;
 }
 
-void VkRenderer::createCommandPool()
+void VkRenderer::createLightingPipeline()
 {
-	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(device.physical);
+	// -- PIPELINE LAYOUT --
+	// set 0: G-buffer input attachments and the lights
+	ShaderReflection vertexReflection(loadSpirv(LIGHTING_VERTEX_SHADER_FILE));
+	ShaderReflection fragReflection(loadSpirv(LIGHTING_FRAGMENT_SHADER_FILE));
+	ShaderLayout layout = ShaderReflection::mergeLayouts({ &vertexReflection, &fragReflection });
+	if (layout.sets.size() != 1 || layout.pushConstantRange.size > 0)
+	{
+		throw std::runtime_error("Lighting shaders must only use descriptor set 0!");
+	}
+	lightingSetLayout = layoutCache->getSetLayout(layout.sets[0]);
+	lightingPipelineLayout = layoutCache->getPipelineLayout({ lightingSetLayout }, {});
+
+	// modules stay alive, their handles are part of the registry key
+	lightingVertexModule = createShaderModule(LIGHTING_VERTEX_SHADER_FILE);
+	lightingFragModule = createShaderModule(LIGHTING_FRAGMENT_SHADER_FILE);
+
+	// -- SHADER STAGE --
+	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = lightingVertexModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = lightingFragModule;
+	shaderStages[1].pName = "main";
+
+	// -- VERTEX INPUT DATA --
+	// full screen triangle generated from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	// Create a graphics queue family cmd pool
-	VkResult result = vkCreateCommandPool(device.logical, &poolInfo, nullptr, &graphicsCommandPool);
-	checkResult(result,"Failed to craete a command pool");
-}
+	// -- VIEWPORT --
+	VkViewport viewportInfo = {};
+	viewportInfo.width = (float)swapChainExtent.width;
+	viewportInfo.height = (float)swapChainExtent.height;
+	viewportInfo.minDepth = 0.0f;
+	viewportInfo.maxDepth = 1.0f;
 
-void VkRenderer::createCommandBuffers()
-{
-	commandBuffers.resize(swapChainFramebuffers.size());
-	VkCommandBufferAllocateInfo commandInfo = {};
-	commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandInfo.commandPool = graphicsCommandPool;
-	commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;		//PRIMARY means executed by a POOL, SECONDARY means executed by another CMD BUFFER PRIMARY
+	VkRect2D scissor = {};
+	scissor.offset = { 0,0 };
+	scissor.extent = swapChainExtent;
 
-	commandInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
-	VkResult result = vkAllocateCommandBuffers(device.logical, &commandInfo, commandBuffers.data());
-	checkResult(result, "Failed to create commadn buffers!");
-	//doenst need to be destoryed like others since we are not creating, we are allocating to the command pool, when the cmd pool is destoryed, also this is destoyed
-}
+	VkPipelineViewportStateCreateInfo viewportStateInfo = {};
+	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateInfo.viewportCount = 1;
+	viewportStateInfo.pViewports = &viewportInfo;
+	viewportStateInfo.scissorCount = 1;
+	viewportStateInfo.pScissors = &scissor;
 
-void VkRenderer::createSynchronization()
-{
-	imageSemaphores.resize(MAX_FRAME_DRAWS);
-	renderSemaphores.resize(MAX_FRAME_DRAWS);
-	drawFences.resize(MAX_FRAME_DRAWS);
+	// -- RASTERIZER --
+	VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
+	rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizerInfo.lineWidth = 1.0f;
+	rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	// -- MULTISAMPLING --
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// -- BLENDING --
+	VkPipelineColorBlendAttachmentState colorAttachmentInfo = {};
+	colorAttachmentInfo.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorAttachmentInfo.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendInfo.attachmentCount = 1;
+	colorBlendInfo.pAttachments = &colorAttachmentInfo;
+
+	// -- GRAPHICS PIPELINE CREATION --
+	// the lighting subpass has no depth attachment, so no depth stencil state
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+	pipelineInfo.pViewportState = &viewportStateInfo;
+	pipelineInfo.pRasterizationState = &rasterizerInfo;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlendInfo;
+	pipelineInfo.layout = lightingPipelineLayout;
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = 1;
+	pipelineInfo.basePipelineIndex = -1;
+
+	uint64_t stateHash = PipelineRegistry::hashState(pipelineInfo);
+	lightingPipeline = pipelineRegistry->find(stateHash);
+	if (lightingPipeline == VK_NULL_HANDLE)
+	{
+		VkPipeline pipeline;
+		VkResult result = vkCreateGraphicsPipelines(device.logical, pipelineCache->getCache(), 1, &pipelineInfo, nullptr, &pipeline);
+		checkResult(result, "Failed to create the lighting pipeline");
+		lightingPipeline = pipelineRegistry->insert(stateHash, pipeline);
+	}
+}
+
+void VkRenderer::createRenderGraph()
+{
+	renderGraph = new RenderGraph(device);
+
+	// swapchain image is available at colour output (image semaphore wait stage) and leaves the frame ready to present
+	swapChainResource = renderGraph->importImage
+	(
+		"swapchain", swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+	);
+
+	// get supported format
+	ImageDesc depthDesc = {};
+	depthDesc.format = chooseSupportedFormat
+	(
+		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+	);
+	depthDesc.extent = swapChainExtent;
+	depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;		// never stored
+	depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	depthDesc.samples = msaaSamples;
+	depthResource = renderGraph->createImage("depth", depthDesc);
+
+	if (!settings.deferred)
+	{
+		// the resolve writes the swapchain image as a colour attachment, so both are colour attachment writes of the pass
+		std::vector<RenderGraphAccess> writes = { { swapChainResource, ResourceUsage::ColorAttachment }, { depthResource, ResourceUsage::DepthAttachment } };
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+		{
+			ImageDesc msaaColorDesc = {};
+			msaaColorDesc.format = swapChainImageFormat;
+			msaaColorDesc.extent = swapChainExtent;
+			msaaColorDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			msaaColorDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			msaaColorDesc.samples = msaaSamples;
+			msaaColorResource = renderGraph->createImage("msaa color", msaaColorDesc);
+			writes.push_back({ msaaColorResource, ResourceUsage::ColorAttachment });
+		}
+
+		renderGraph->addPass
+		(
+			"forward", {}, writes,
+			[this](VkCommandBuffer cmdBuffer, uint32_t imageIndex) { recordForwardPass(cmdBuffer, imageIndex); }
+		);
+	}
+	else
+	{
+		// G-buffer lives and dies inside the one render pass, the graph only sees it as attachments of that pass
+		static const char* gbufferNames[] = { "gbuffer albedo", "gbuffer position", "gbuffer normal" };
+		std::vector<RenderGraphAccess> writes = { { swapChainResource, ResourceUsage::ColorAttachment }, { depthResource, ResourceUsage::DepthAttachment } };
+		for (size_t i = 0; i < GBUFFER_FORMATS.size(); i++)
+		{
+			ImageDesc gbufferDesc = {};
+			gbufferDesc.format = GBUFFER_FORMATS[i];
+			gbufferDesc.extent = swapChainExtent;
+			gbufferDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			gbufferDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			gbufferResources[i] = renderGraph->createImage(gbufferNames[i], gbufferDesc);
+			writes.push_back({ gbufferResources[i], ResourceUsage::ColorAttachment });
+		}
+
+		renderGraph->addPass
+		(
+			"deferred", {}, writes,
+			[this](VkCommandBuffer cmdBuffer, uint32_t imageIndex) { recordDeferredPass(cmdBuffer, imageIndex); }
+		);
+	}
+
+	renderGraph->compile();
+	printf("Render graph: %llu KB transient memory, %llu KB of it lazily allocated\n",
+		static_cast<unsigned long long>(renderGraph->getTransientMemorySize() / 1024), static_cast<unsigned long long>(renderGraph->getLazyMemorySize() / 1024));
+}
+
+void VkRenderer::createFrameBuffers()
+{
+	swapChainFramebuffers.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+	{
+		std::vector<VkImageView> attachments =
+		{
+			swapChainImages[i].imageView,
+			renderGraph->getImageView(depthResource)
+		};
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+		{
+			attachments.push_back(renderGraph->getImageView(msaaColorResource));
+		}
+		if (settings.deferred)
+		{
+			for (size_t gbufferResource : gbufferResources)
+			{
+				attachments.push_back(renderGraph->getImageView(gbufferResource));
+			}
+		}
+
+
+		VkFramebufferCreateInfo frameBufferInfo = {};		
+		frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		frameBufferInfo.renderPass = renderPass;											// render pass layout the framebuffei will be used ith
+		frameBufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());		
+		frameBufferInfo.pAttachments = attachments.data();									// list of attachmetns 1 to 1 with render pass
+		frameBufferInfo.width = swapChainExtent.width;										
+		frameBufferInfo.height = swapChainExtent.height;
+		frameBufferInfo.layers = 1;
+
+		VkResult result = vkCreateFramebuffer(device.logical, &frameBufferInfo, nullptr, &swapChainFramebuffers[i]);
+		checkResult(result, "Failed to create a frame buffer");
+
+	}
+}
+
+void VkRenderer::createCommandPool()
+{
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(device.physical);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+	// Create a graphics queue family cmd pool
+	VkResult result = vkCreateCommandPool(device.logical, &poolInfo, nullptr, &graphicsCommandPool);
+	checkResult(result,"Failed to craete a command pool");
+
+	// Compute cmd pool, command buffers have to come from a pool of the family they are submitted to
+	poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily;
+	result = vkCreateCommandPool(device.logical, &poolInfo, nullptr, &computeCommandPool);
+	checkResult(result, "Failed to create a compute command pool");
+}
+
+void VkRenderer::createCommandBuffers()
+{
+	commandBuffers.resize(swapChainFramebuffers.size());
+	VkCommandBufferAllocateInfo commandInfo = {};
+	commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandInfo.commandPool = graphicsCommandPool;
+	commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;		//PRIMARY means executed by a POOL, SECONDARY means executed by another CMD BUFFER PRIMARY
+
+	commandInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	VkResult result = vkAllocateCommandBuffers(device.logical, &commandInfo, commandBuffers.data());
+	checkResult(result, "Failed to create commadn buffers!");
+	//doenst need to be destoryed like others since we are not creating, we are allocating to the command pool, when the cmd pool is destoryed, also this is destoyed
+
+	// compute work is recorded per frame in flight rather than per swapchain image
+	computeCommandBuffers.resize(MAX_FRAME_DRAWS);
+	commandInfo.commandPool = computeCommandPool;
+	commandInfo.commandBufferCount = static_cast<uint32_t>(computeCommandBuffers.size());
+	result = vkAllocateCommandBuffers(device.logical, &commandInfo, computeCommandBuffers.data());
+	checkResult(result, "Failed to create compute command buffers!");
+}
+
+void VkRenderer::createSynchronization()
+{
+	imageSemaphores.resize(MAX_FRAME_DRAWS);
+	renderSemaphores.resize(MAX_FRAME_DRAWS);
+	computeSemaphores.resize(MAX_FRAME_DRAWS);
+	drawFences.resize(MAX_FRAME_DRAWS);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -781,6 +1368,7 @@ void VkRenderer::createSynchronization()
 		if (
 			vkCreateSemaphore(device.logical, &semaphoreInfo, nullptr, &imageSemaphores[i]) != VK_SUCCESS ||
 			vkCreateSemaphore(device.logical, &semaphoreInfo, nullptr, &renderSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(device.logical, &semaphoreInfo, nullptr, &computeSemaphores[i]) != VK_SUCCESS ||
 			vkCreateFence(device.logical, &fenceInfo, nullptr, &drawFences[i]) != VK_SUCCESS
 			)
 		{
@@ -790,6 +1378,34 @@ void VkRenderer::createSynchronization()
 	}
 }
 
+void VkRenderer::createTimestampQueryPool()
+{
+	// graphics queue must be able to write timestamps, otherwise gpu timings are simply not reported
+	QueueFamilyIndices indices = getQueueFamilies(device.physical);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device.physical, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device.physical, &queueFamilyCount, queueFamilyList.data());
+
+	uint32_t validBits = queueFamilyList[indices.graphicsFamily].timestampValidBits;
+	if (validBits == 0 || timestampPeriod <= 0.0f)
+	{
+		return;
+	}
+	timestampMask = validBits < 64 ? (1ull << validBits) - 1 : ~0ull;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = static_cast<uint32_t>(MAX_FRAME_DRAWS * 2);		// begin + end for each frame in flight
+
+	VkResult result = vkCreateQueryPool(device.logical, &queryPoolInfo, nullptr, &timestampQueryPool);
+	checkResult(result, "Failed to create timestamp query pool");
+
+	timestampsWritten.resize(MAX_FRAME_DRAWS, false);
+}
+
 void VkRenderer::createMesh()
 {
 	// vertex data should be overlapping without index data
@@ -826,34 +1442,38 @@ void VkRenderer::createMesh()
 		0, 1, 2,
 		2, 3, 0
 	};
-	Mesh* firstMesh = new Mesh(device, graphicsQueue, graphicsCommandPool, &meshVertices1, &meshIndices, createTexture("brick.png"));
-	Mesh* secondMesh = new Mesh(device, graphicsQueue, graphicsCommandPool, &meshVertices2, &meshIndices, createTexture("brick.png"));
-	meshes.push_back(firstMesh);
-	meshes.push_back(secondMesh);
+	// generated meshes go through the same reordering as imported ones, each with its own copy of the indices
+	std::vector<uint32_t> meshIndices1 = meshIndices;
+	std::vector<uint32_t> meshIndices2 = meshIndices;
+	optimizeMesh(meshVertices1.data(), meshVertices1.size(), sizeof(Vertex), meshIndices1.data(), meshIndices1.size());
+	optimizeMesh(meshVertices2.data(), meshVertices2.size(), sizeof(Vertex), meshIndices2.data(), meshIndices2.size());
+
+	std::vector<size_t> texIds = createTextures({ "brick.png", "brick.png" });
+	meshes.push_back(createPackedMesh(meshVertices1, meshIndices1, texIds[0]));
+	meshes.push_back(createPackedMesh(meshVertices2, meshIndices2, texIds[1]));
+
+	// second quad shows its vertex colours over the texture
+	setMeshFeatures(1, PIPELINE_FEATURE_TEXTURED | PIPELINE_FEATURE_VERTEX_COLOR);
 
 }
 
-void VkRenderer::createTextureSampler()
+Mesh* VkRenderer::createPackedMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t texId)
 {
-	VkSamplerCreateInfo samplerInfo{};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
-	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16;
-
-	VkResult result = vkCreateSampler(device.logical, &samplerInfo, nullptr, &textureSampler);
-	checkResult(result, "Failed to create a texture sampler");
+	PositionQuantization quantization;
+	uint32_t stride = packVertices(vertices.data(), vertices.size(), settings.vertexLayout, &quantization);
+	VkIndexType indexType = packIndices(indices.data(), indices.size(), vertices.size());
+
+	Mesh* mesh = new Mesh(device, graphicsQueue, graphicsCommandPool,
+		vertices.data(), static_cast<VkDeviceSize>(vertices.size()) * stride, vertices.size(),
+		indices.data(), static_cast<VkDeviceSize>(indices.size()) * indexTypeSize(indexType), indices.size(), texId);
+	mesh->setIndexType(indexType);
+	mesh->setPositionQuantization(quantization);
+	return mesh;
+}
 
+void VkRenderer::createSamplerCache()
+{
+	samplerCache = new SamplerCache(device);
 }
 
 void VkRenderer::createUniformBuffers()
@@ -872,6 +1492,17 @@ void VkRenderer::createUniformBuffers()
 		createBuffer(device, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
 	}
+
+	// Lights buffers, deferred path only
+	if (!settings.deferred) return;
+
+	lightUniformBuffer.resize(swapChainImages.size());
+	lightUniformBufferMemory.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		createBuffer(device, sizeof(UboLights), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &lightUniformBuffer[i], &lightUniformBufferMemory[i]);
+	}
 }
 
 void VkRenderer::createDescriptorPool()
@@ -912,6 +1543,25 @@ void VkRenderer::createDescriptorPool()
 
 	result = vkCreateDescriptorPool(device.logical, &samplerPoolInfo, nullptr, &samplerDescriptorPool);
 	checkResult(result, "failed to create sampler descriptor pool");
+
+	//-- CREATE LIGHTING DESCRIPTOR POOL
+	// G-buffer input attachments + lights, one set per swap chain image
+	if (!settings.deferred) return;
+
+	std::array<VkDescriptorPoolSize, 2> lightingPoolSizes = {};
+	lightingPoolSizes[0].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	lightingPoolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size() * GBUFFER_FORMATS.size());
+	lightingPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lightingPoolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+
+	VkDescriptorPoolCreateInfo lightingPoolInfo = {};
+	lightingPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	lightingPoolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+	lightingPoolInfo.poolSizeCount = static_cast<uint32_t>(lightingPoolSizes.size());
+	lightingPoolInfo.pPoolSizes = lightingPoolSizes.data();
+
+	result = vkCreateDescriptorPool(device.logical, &lightingPoolInfo, nullptr, &lightingDescriptorPool);
+	checkResult(result, "Failed to create lighting descriptor pool");
 }
 
 void VkRenderer::createDescriptorSets()
@@ -959,6 +1609,62 @@ void VkRenderer::createDescriptorSets()
 		vkUpdateDescriptorSets(device.logical, static_cast<uint32_t>(setWrites.size()), setWrites.data(),
 			0, nullptr);
 	}
+
+	if (!settings.deferred) return;
+
+	// LIGHTING DESCRIPTORS
+	// G-buffer views are the same for every image, the lights buffer is per image like the view projection one
+	lightingDescriptorSets.resize(swapChainImages.size());
+	std::vector<VkDescriptorSetLayout> lightingSetLayouts(swapChainImages.size(), lightingSetLayout);
+
+	VkDescriptorSetAllocateInfo lightingAllocInfo = {};
+	lightingAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	lightingAllocInfo.descriptorPool = lightingDescriptorPool;
+	lightingAllocInfo.descriptorSetCount = static_cast<uint32_t>(lightingSetLayouts.size());
+	lightingAllocInfo.pSetLayouts = lightingSetLayouts.data();
+
+	result = vkAllocateDescriptorSets(device.logical, &lightingAllocInfo, lightingDescriptorSets.data());
+	checkResult(result, "Failed to allocate lighting Descriptor Sets!");
+
+	std::array<VkDescriptorImageInfo, GBUFFER_FORMATS.size()> gbufferInfos = {};
+	for (size_t g = 0; g < GBUFFER_FORMATS.size(); g++)
+	{
+		gbufferInfos[g].imageView = renderGraph->getImageView(gbufferResources[g]);
+		gbufferInfos[g].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;			// layout inside the lighting subpass
+		gbufferInfos[g].sampler = VK_NULL_HANDLE;
+	}
+
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		VkDescriptorBufferInfo lightsBufferInfo = {};
+		lightsBufferInfo.buffer = lightUniformBuffer[i];
+		lightsBufferInfo.offset = 0;
+		lightsBufferInfo.range = sizeof(UboLights);
+
+		std::vector<VkWriteDescriptorSet> setWrites;
+		for (size_t g = 0; g < GBUFFER_FORMATS.size(); g++)
+		{
+			VkWriteDescriptorSet gbufferWrite = {};
+			gbufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			gbufferWrite.dstSet = lightingDescriptorSets[i];
+			gbufferWrite.dstBinding = static_cast<uint32_t>(g);
+			gbufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			gbufferWrite.descriptorCount = 1;
+			gbufferWrite.pImageInfo = &gbufferInfos[g];
+			setWrites.push_back(gbufferWrite);
+		}
+
+		VkWriteDescriptorSet lightsWrite = {};
+		lightsWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		lightsWrite.dstSet = lightingDescriptorSets[i];
+		lightsWrite.dstBinding = static_cast<uint32_t>(GBUFFER_FORMATS.size());
+		lightsWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		lightsWrite.descriptorCount = 1;
+		lightsWrite.pBufferInfo = &lightsBufferInfo;
+		setWrites.push_back(lightsWrite);
+
+		vkUpdateDescriptorSets(device.logical, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
 }
 
 void VkRenderer::updateUniformBuffers(uint32_t imgIndex)
@@ -970,6 +1676,14 @@ void VkRenderer::updateUniformBuffers(uint32_t imgIndex)
 	vkMapMemory(device.logical, vpUniformBufferMemory[imgIndex], 0, bufferSize, 0, &data);
 	memcpy(data, &uboVP, bufferSize);
 	vkUnmapMemory(device.logical, vpUniformBufferMemory[imgIndex]);
+
+	// Copy lights
+	if (settings.deferred)
+	{
+		vkMapMemory(device.logical, lightUniformBufferMemory[imgIndex], 0, sizeof(UboLights), 0, &data);
+		memcpy(data, &uboLights, sizeof(UboLights));
+		vkUnmapMemory(device.logical, lightUniformBufferMemory[imgIndex]);
+	}
 }
 
 void VkRenderer::recordCommands(uint32_t imageIndex)
@@ -978,9 +1692,40 @@ void VkRenderer::recordCommands(uint32_t imageIndex)
 	VkCommandBufferBeginInfo cmdBufferBeginInfo = {};
 	cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-	std::array<VkClearValue, 2> clearValues{};
+	VkResult result = vkBeginCommandBuffer(commandBuffers[imageIndex], &cmdBufferBeginInfo);
+	checkResult(result, "Failed to start recording a command buffer!");
+
+		uint32_t firstQuery = static_cast<uint32_t>(currentFrame * 2);
+		if (timestampQueryPool != VK_NULL_HANDLE)
+		{
+			// queries have to be reset outside of a render pass before being written again
+			vkCmdResetQueryPool(commandBuffers[imageIndex], timestampQueryPool, firstQuery, 2);
+			vkCmdWriteTimestamp(commandBuffers[imageIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery);
+		}
+
+		recordComputeAcquireBarriers(commandBuffers[imageIndex]);
+
+		// passes and the barriers between them
+		renderGraph->setImportedImage(swapChainResource, swapChainImages[imageIndex].image, swapChainImages[imageIndex].imageView);
+		renderGraph->execute(commandBuffers[imageIndex], imageIndex);
+
+		if (timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkCmdWriteTimestamp(commandBuffers[imageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 1);
+			timestampsWritten[currentFrame] = true;
+		}
+
+	result = vkEndCommandBuffer(commandBuffers[imageIndex]);
+	checkResult(result, "Failed to stop recording a command buffer");
+}
+
+void VkRenderer::recordForwardPass(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+	// swapchain, depth, multisampled colour when MSAA is on (the swapchain is then only resolved into)
+	std::array<VkClearValue, 3> clearValues{};
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
 	clearValues[1].depthStencil.depth = 1.0f;
+	clearValues[2].color = { 0.0f, 0.0f, 0.0f, 1.0f };
 
 	//Info about how to begin a render pass, only need for graphical application
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
@@ -989,95 +1734,423 @@ void VkRenderer::recordCommands(uint32_t imageIndex)
 	renderPassBeginInfo.renderArea.offset = { 0,0 };
 	renderPassBeginInfo.renderArea.extent = swapChainExtent;
 	renderPassBeginInfo.pClearValues = clearValues.data();
-	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());		// extra values are ignored
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordMeshes(cmdBuffer, imageIndex);
+	vkCmdEndRenderPass(cmdBuffer);
+}
 
+void VkRenderer::recordDeferredPass(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+	// swapchain (not loaded), depth, G-buffer. Position w = 0 marks pixels nothing was drawn to
+	std::array<VkClearValue, 2 + GBUFFER_FORMATS.size()> clearValues{};
+	clearValues[1].depthStencil.depth = 1.0f;
 
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.renderArea.offset = { 0,0 };
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+	renderPassBeginInfo.pClearValues = clearValues.data();
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
-	VkResult result = vkBeginCommandBuffer(commandBuffers[imageIndex], &cmdBufferBeginInfo);
-	checkResult(result, "Failed to start recording a command buffer!");
 
-		vkCmdBeginRenderPass(commandBuffers[imageIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			
-			vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			for(size_t j = 0; j < meshes.size(); j++)
-			{
-				VkBuffer vertexBuffers[] = { meshes[j]->getVertexBuffer()};
-				VkDeviceSize offsets[] = { 0 };
-				vkCmdBindVertexBuffers(commandBuffers[imageIndex], 0, 1, vertexBuffers, offsets);
-				vkCmdBindIndexBuffer(commandBuffers[imageIndex], meshes[j]->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-				vkCmdPushConstants(commandBuffers[imageIndex], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &meshes[j]->getModel());
-
-				std::array<VkDescriptorSet, 2> descriptorSetGroup = { descriptorSets[imageIndex], samplerDescriptorSets[meshes[j]->getTexId()] };
-				vkCmdBindDescriptorSets
-				(
-					commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 
-					static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(),
-					0, nullptr
-				);  //Bind descriptor sets
-				vkCmdDrawIndexed(commandBuffers[imageIndex], meshes[j]->getIndexCount(), 1, 0, 0, 0);
-			}
+		// -- G-BUFFER SUBPASS --
+		recordMeshes(cmdBuffer, imageIndex);
 
-		vkCmdEndRenderPass(commandBuffers[imageIndex]);
+		// -- LIGHTING SUBPASS --
+		vkCmdNextSubpass(cmdBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipeline);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelineLayout, 0, 1, &lightingDescriptorSets[imageIndex], 0, nullptr);
+		vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
 
-	result = vkEndCommandBuffer(commandBuffers[imageIndex]);
-	checkResult(result, "Failed to stop recording a command buffer");
+	vkCmdEndRenderPass(cmdBuffer);
 }
 
-void VkRenderer::getPhysicalDevice()
+void VkRenderer::recordMeshes(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
 {
-	// Enumerate Physical devices the vkInstance can access
-	uint32_t deviceCount = 0;
-	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	// every pipeline has the same layout, so bound sets stay valid across pipeline changes
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[imageIndex], 0, nullptr);
 
-	// If no devices available, then none support Vulkan!
-	if (deviceCount == 0)
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkDescriptorSet boundTextureSet = VK_NULL_HANDLE;
+	for(size_t j = 0; j < meshes.size(); j++)
 	{
-		throw std::runtime_error("Can't find GPUs that support Vulkan Instance!");
-	}
+		// only rebind when the variant changes between meshes
+		VkPipeline pipeline = getGraphicsPipeline(meshes[j]->getFeatures());
+		if (pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
 
-	// Get list of Physical Devices
-	std::vector<VkPhysicalDevice> deviceList(deviceCount);
-	vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
+		VkBuffer vertexBuffers[] = { meshes[j]->getVertexBuffer()};
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(cmdBuffer, meshes[j]->getIndexBuffer(), 0, meshes[j]->getIndexType());
 
-	for (const auto& device : deviceList)
-	{
-		if (checkDeviceSuitable(device))
+		// meshes on layers of the same array image only differ in the pushed layer
+		const TextureLayer& texture = textures[meshes[j]->getTexId()];
+		PushModel pushModel = { meshes[j]->getModel() * meshes[j]->getPositionTransform(), texture.layer };
+		uint32_t pushSize = std::min(pushConstantRange.size, static_cast<uint32_t>(sizeof(PushModel)));		// shaders without a layer take the matrix only
+		vkCmdPushConstants(cmdBuffer, pipelineLayout, pushConstantRange.stageFlags, 0, pushSize, &pushModel);
+
+		VkDescriptorSet textureSet = samplerDescriptorSets[texture.descriptorId];
+		if (textureSet != boundTextureSet)
 		{
-			this->device.physical = device;
-			break;
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureSet, 0, nullptr);
+			boundTextureSet = textureSet;
 		}
+		vkCmdDrawIndexed(cmdBuffer, meshes[j]->getIndexCount(), 1, 0, 0, 0);
 	}
-
-	// Get properties of our new physical device and save the min offset alignemnt info
-	VkPhysicalDeviceProperties deviceProperties = {};
-	vkGetPhysicalDeviceProperties(device.physical, &deviceProperties);
 }
 
-bool VkRenderer::checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions)
+void VkRenderer::recordComputeCommands()
 {
-	std::unordered_set<std::string> availableExtensions = GetInstanceExtensions();
-	if (availableExtensions.size() == 0) return false;
-	for (const char* checkExtension : *checkExtensions)
+	VkCommandBuffer cmdBuffer = computeCommandBuffers[currentFrame];
+
+	// draw fence of this frame slot is open, so the graphics work that waited on the last use of this buffer is done
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult result = vkBeginCommandBuffer(cmdBuffer, &beginInfo);
+	checkResult(result, "Failed to start recording a compute command buffer!");
+
+	bool ownershipTransfer = queueFamilies.computeFamily != queueFamilies.graphicsFamily;
+	std::vector<VkBufferMemoryBarrier> releaseBarriers;
+
+	for (const ComputeDispatch& dispatch : computeDispatches)
 	{
-		if (availableExtensions.find(checkExtension) == availableExtensions.end()) return false;
+		const ComputePipeline& computePipeline = computePipelines[dispatch.pipelineId];
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.pipeline);
+
+		if (dispatch.descriptorSets[currentFrame] != VK_NULL_HANDLE)
+		{
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.layout, 0,
+				1, &dispatch.descriptorSets[currentFrame], 0, nullptr);
+		}
+		if (!dispatch.pushConstants.empty())
+		{
+			vkCmdPushConstants(cmdBuffer, computePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+				static_cast<uint32_t>(dispatch.pushConstants.size()), dispatch.pushConstants.data());
+		}
+		vkCmdDispatch(cmdBuffer, dispatch.groupCountX, dispatch.groupCountY, dispatch.groupCountZ);
+
+		// exclusive buffers written on another family must be released to the graphics family (acquired in recordComputeAcquireBarriers)
+		if (ownershipTransfer && dispatch.outputBuffers[currentFrame] != VK_NULL_HANDLE)
+		{
+			VkBufferMemoryBarrier release = {};
+			release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			release.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			release.dstAccessMask = 0;												// ignored for a release
+			release.srcQueueFamilyIndex = static_cast<uint32_t>(queueFamilies.computeFamily);
+			release.dstQueueFamilyIndex = static_cast<uint32_t>(queueFamilies.graphicsFamily);
+			release.buffer = dispatch.outputBuffers[currentFrame];
+			release.offset = 0;
+			release.size = VK_WHOLE_SIZE;
+			releaseBarriers.push_back(release);
+		}
 	}
-	return true;
+
+	if (!releaseBarriers.empty())
+	{
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+	}
+
+	result = vkEndCommandBuffer(cmdBuffer);
+	checkResult(result, "Failed to stop recording a compute command buffer");
 }
 
-bool VkRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
+void VkRenderer::recordComputeAcquireBarriers(VkCommandBuffer cmdBuffer)
 {
-	// Get device extension count
-	uint32_t extensionCount = 0;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	// same family: the semaphore alone makes compute writes visible
+	if (queueFamilies.computeFamily == queueFamilies.graphicsFamily) return;
 
-	// If no extensions found, return failure
-	if (extensionCount == 0)
+	std::vector<VkBufferMemoryBarrier> acquireBarriers;
+	for (const ComputeDispatch& dispatch : computeDispatches)
 	{
-		return false;
+		if (dispatch.outputBuffers[currentFrame] == VK_NULL_HANDLE) continue;
+
+		VkBufferMemoryBarrier acquire = {};
+		acquire.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		acquire.srcAccessMask = 0;													// ignored for an acquire
+		acquire.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		acquire.srcQueueFamilyIndex = static_cast<uint32_t>(queueFamilies.computeFamily);
+		acquire.dstQueueFamilyIndex = static_cast<uint32_t>(queueFamilies.graphicsFamily);
+		acquire.buffer = dispatch.outputBuffers[currentFrame];
+		acquire.offset = 0;
+		acquire.size = VK_WHOLE_SIZE;
+		acquireBarriers.push_back(acquire);
 	}
 
-	// Populate list of extensions
+	if (acquireBarriers.empty()) return;
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, static_cast<uint32_t>(acquireBarriers.size()), acquireBarriers.data(), 0, nullptr);
+}
+
+void VkRenderer::updateShaderReload()
+{
+	// fence of this frame slot was just waited on, every frame up to frameNumber - MAX_FRAME_DRAWS has finished
+	for (size_t i = 0; i < retiredPipelines.size(); )
+	{
+		if (retiredPipelines[i].destroyFrame <= frameNumber)
+		{
+			vkDestroyPipeline(device.logical, retiredPipelines[i].pipeline, nullptr);
+			retiredPipelines[i] = retiredPipelines.back();
+			retiredPipelines.pop_back();
+			continue;
+		}
+		i++;
+	}
+
+	// never block the frame on a rebuild, check again next frame
+	if (shaderReload.valid())
+	{
+		if (shaderReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+		try
+		{
+			applyShaderReload(shaderReload.get());
+		}
+		catch (const std::runtime_error& e) {
+			printf("Shader reload failed, keeping the current pipelines: %s\n", e.what());
+			pipelineCache->mergeWorkerCaches();
+		}
+	}
+
+	std::vector<std::string> changedFiles = shaderWatcher->takeChangedFiles();
+	if (changedFiles.empty())
+	{
+		// stale variants stay bound until this lands. A graphics shader change rebuilds them with everything else instead
+		if (rebuildStaleVariants)
+		{
+			rebuildStaleVariants = false;
+			shaderReload = threadPool->submit([this, stale = staleVariants, vertexModule = vertexShaderModule, fragModule = fragShaderModule]()
+			{
+				ShaderReload reload;
+				reload.graphicsPipelines = createGraphicsPipelineVariants(stale, vertexModule, fragModule, pipelineCache->createWorkerCache());
+				return reload;
+			});
+		}
+		return;
+	}
+
+	// variants and compute sources are copied here, both belong to the render thread
+	std::vector<PipelineFeatures> variants;
+	for (const auto& variant : graphicsPipelines)
+	{
+		variants.push_back(variant.first);
+	}
+	std::vector<ComputePipeline> computeSources = computePipelines;
+	shaderReload = threadPool->submit([this, changedFiles, variants, computeSources]() { return rebuildShaders(changedFiles, variants, computeSources); });
+}
+
+ShaderReload VkRenderer::rebuildShaders(const std::vector<std::string>& changedFiles, const std::vector<PipelineFeatures>& variants,
+	const std::vector<ComputePipeline>& computeSources)
+{
+	auto isChanged = [&changedFiles](const std::string& fileName)
+	{
+		for (const std::string& changedFile : changedFiles)
+		{
+			if (std::filesystem::path(changedFile).lexically_normal() == std::filesystem::path(fileName).lexically_normal()) return true;
+		}
+		return false;
+	};
+
+	ShaderReload reload;
+	VkPipelineCache workerCache = pipelineCache->createWorkerCache();
+	try
+	{
+		// only pipelines built from a changed source are rebuilt
+		if (isChanged(vertexShaderFile) || isChanged(fragShaderFile))
+		{
+			// descriptor sets, push constants and vertex buffers are set up for the old interface
+			ShaderReflection vertexReflection(loadSpirv(vertexShaderFile));
+			ShaderReflection fragReflection(loadSpirv(fragShaderFile));
+			uint32_t stride;
+			std::vector<VkVertexInputAttributeDescription> attributes = createVertexInput(vertexReflection, &stride);
+			bool sameInputs = stride == vertexStride && attributes.size() == vertexAttributes.size() && std::equal(attributes.begin(), attributes.end(), vertexAttributes.begin(),
+				[](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) { return a.location == b.location && a.format == b.format; });
+			if (!sameInputs || !ShaderReflection::equalLayouts(ShaderReflection::mergeLayouts({ &vertexReflection, &fragReflection }), graphicsLayout))
+			{
+				throw std::runtime_error("Shader inputs, bindings or push constants changed, restart to apply!");
+			}
+			reload.vertexModule = createShaderModule(vertexShaderFile);
+			reload.fragModule = createShaderModule(fragShaderFile);
+			reload.graphicsPipelines = createGraphicsPipelineVariants(variants, reload.vertexModule, reload.fragModule, workerCache);
+		}
+		for (size_t i = 0; i < computeSources.size(); i++)
+		{
+			if (!isChanged(computeSources[i].fileName)) continue;
+			reload.computePipelines.push_back({ i, buildComputePipeline(computeSources[i].fileName, computeSources[i].layout, workerCache) });
+		}
+	}
+	catch (...)
+	{
+		// nothing half built may reach the render loop
+		for (const PipelineBuildResult& built : reload.graphicsPipelines)
+		{
+			pipelineRegistry->remove(built.pipeline);
+			vkDestroyPipeline(device.logical, built.pipeline, nullptr);
+		}
+		for (const auto& rebuilt : reload.computePipelines)
+		{
+			vkDestroyPipeline(device.logical, rebuilt.second, nullptr);
+		}
+		if (reload.vertexModule != VK_NULL_HANDLE) vkDestroyShaderModule(device.logical, reload.vertexModule, nullptr);
+		if (reload.fragModule != VK_NULL_HANDLE) vkDestroyShaderModule(device.logical, reload.fragModule, nullptr);
+		throw;
+	}
+	return reload;
+}
+
+void VkRenderer::applyShaderReload(const ShaderReload& reload)
+{
+	if (reload.vertexModule != VK_NULL_HANDLE)
+	{
+		// pipelines keep working after their modules are gone, only new variants need the new ones
+		vkDestroyShaderModule(device.logical, vertexShaderModule, nullptr);
+		vkDestroyShaderModule(device.logical, fragShaderModule, nullptr);
+		vertexShaderModule = reload.vertexModule;
+		fragShaderModule = reload.fragModule;
+
+		std::unordered_map<PipelineFeatures, VkPipeline> rebuilt;
+		for (const PipelineBuildResult& built : reload.graphicsPipelines)
+		{
+			rebuilt[built.features] = built.pipeline;
+		}
+		// variants created while the rebuild ran still use the old shaders. They stay bound, out of the registry since their
+		// modules are gone, until a follow-up rebuild on the thread pool replaces them
+		std::vector<PipelineFeatures> stale;
+		for (const auto& variant : graphicsPipelines)
+		{
+			pipelineRegistry->remove(variant.second);
+			if (rebuilt.insert(variant).second)
+			{
+				stale.push_back(variant.first);
+				continue;
+			}
+			retirePipeline(variant.second);
+		}
+		graphicsPipelines = rebuilt;
+		staleVariants = stale;
+		rebuildStaleVariants = !staleVariants.empty();
+	}
+	else
+	{
+		// follow-up rebuild of the stale variants, built with the modules that are still current
+		for (const PipelineBuildResult& built : reload.graphicsPipelines)
+		{
+			retirePipeline(graphicsPipelines[built.features]);
+			graphicsPipelines[built.features] = built.pipeline;
+			staleVariants.erase(std::remove(staleVariants.begin(), staleVariants.end(), built.features), staleVariants.end());
+		}
+	}
+
+	for (const auto& rebuilt : reload.computePipelines)
+	{
+		retirePipeline(computePipelines[rebuilt.first].pipeline);
+		computePipelines[rebuilt.first].pipeline = rebuilt.second;
+	}
+
+	pipelineCache->mergeWorkerCaches();
+	printf("Shader reload: swapped %zu graphics and %zu compute pipelines\n", reload.graphicsPipelines.size(), reload.computePipelines.size());
+}
+
+void VkRenderer::retirePipeline(VkPipeline pipeline)
+{
+	// command buffers recorded up to the previous frame may still reference it
+	retiredPipelines.push_back({ pipeline, frameNumber + MAX_FRAME_DRAWS - 1 });
+}
+
+void VkRenderer::readTimestamps()
+{
+	frameTimings.gpuValid = false;
+	if (timestampQueryPool == VK_NULL_HANDLE || !timestampsWritten[currentFrame]) return;
+
+	// results belong to the frame submitted MAX_FRAME_DRAWS draws ago in this slot
+	uint64_t timestamps[2];
+	VkResult result = vkGetQueryPoolResults(device.logical, timestampQueryPool, static_cast<uint32_t>(currentFrame * 2), 2,
+		sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) return;
+
+	// masked difference stays correct when the counter wrapped between the two writes
+	frameTimings.gpuMs = static_cast<double>((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod / 1000000.0;
+	frameTimings.gpuValid = true;
+}
+
+void VkRenderer::getPhysicalDevice()
+{
+	// Enumerate Physical devices the vkInstance can access
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+	// If no devices available, then none support Vulkan!
+	if (deviceCount == 0)
+	{
+		throw std::runtime_error("Can't find GPUs that support Vulkan Instance!");
+	}
+
+	// Get list of Physical Devices
+	std::vector<VkPhysicalDevice> deviceList(deviceCount);
+	vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
+
+	for (const auto& device : deviceList)
+	{
+		if (checkDeviceSuitable(device))
+		{
+			this->device.physical = device;
+			break;
+		}
+	}
+
+	// Get properties of our new physical device and save the min offset alignemnt info
+	VkPhysicalDeviceProperties deviceProperties = {};
+	vkGetPhysicalDeviceProperties(device.physical, &deviceProperties);
+
+	timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+	// colour and depth are rendered with the same sample count, so it has to be in both limits
+	VkSampleCountFlags supportedSamples = deviceProperties.limits.framebufferColorSampleCounts & deviceProperties.limits.framebufferDepthSampleCounts;
+	msaaSamples = chooseSampleCount(settings.msaaSamples, supportedSamples);
+	if (msaaSamples != settings.msaaSamples)
+	{
+		printf("MSAA: %ux requested, using %ux\n", static_cast<uint32_t>(settings.msaaSamples), static_cast<uint32_t>(msaaSamples));
+	}
+}
+
+bool VkRenderer::checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions)
+{
+	std::unordered_set<std::string> availableExtensions = GetInstanceExtensions();
+	if (availableExtensions.size() == 0) return false;
+	for (const char* checkExtension : *checkExtensions)
+	{
+		if (availableExtensions.find(checkExtension) == availableExtensions.end()) return false;
+	}
+	return true;
+}
+
+bool VkRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
+{
+	// Get device extension count
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	// If no extensions found, return failure
+	if (extensionCount == 0)
+	{
+		return false;
+	}
+
+	// Populate list of extensions
 	std::vector<VkExtensionProperties> extensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
 
@@ -1181,11 +2254,12 @@ QueueFamilyIndices VkRenderer::getQueueFamilies(VkPhysicalDevice device)
 
 	// Go through each queue family and check if it has at least 1 of the required types of queue
 	int i = 0;
+	int sharedComputeFamily = -1;
 	for (const auto& queueFamily : queueFamilyList)
 	{
 		// First check if queue family has at least 1 queue in that family (could have no queues)
 		// Queue can be multiple types defined through bitfield. Need to bitwise AND with VK_QUEUE_*_BIT to check if has required type
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		if (indices.graphicsFamily < 0 && queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 		{
 			indices.graphicsFamily = i;		// If queue family is valid, then get index
 		}
@@ -1194,20 +2268,33 @@ QueueFamilyIndices VkRenderer::getQueueFamilies(VkPhysicalDevice device)
 		VkBool32 presentationSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
 		// Check if queue is presentation type (can be both graphics and presentation)
-		if (queueFamily.queueCount > 0 && presentationSupport)
+		if (indices.presentationFamily < 0 && queueFamily.queueCount > 0 && presentationSupport)
 		{
 			indices.presentationFamily = i;
 		}
 
-		// Check if queue family indices are in a valid state, stop searching if so
-		if (indices.isValid())
+		// Compute without graphics is a dedicated async family, work submitted there can overlap rasterization
+		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
 		{
-			break;
+			if (!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				if (indices.computeFamily < 0) indices.computeFamily = i;
+			}
+			else if (sharedComputeFamily < 0)
+			{
+				sharedComputeFamily = i;
+			}
 		}
 
 		i++;
 	}
 
+	// No dedicated family, fall back to a family that also does graphics
+	if (indices.computeFamily < 0)
+	{
+		indices.computeFamily = sharedComputeFamily;
+	}
+
 	return indices;
 }
 
@@ -1347,7 +2434,24 @@ VkFormat VkRenderer::chooseSupportedFormat(const std::vector<VkFormat>& formats,
 	throw std::runtime_error("Failed to find a matching format!");
 }
 
-VkImage VkRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+VkSampleCountFlagBits VkRenderer::chooseSampleCount(VkSampleCountFlagBits requested, VkSampleCountFlags supported)
+{
+	// the deferred lighting subpass reads single sample input attachments
+	if (settings.deferred) return VK_SAMPLE_COUNT_1_BIT;
+
+	// highest supported count not above the requested one, 1 sample is always supported
+	for (uint32_t samples = VK_SAMPLE_COUNT_64_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1)
+	{
+		if (samples <= static_cast<uint32_t>(requested) && (supported & samples))
+		{
+			return static_cast<VkSampleCountFlagBits>(samples);
+		}
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkImage VkRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory,
+	uint32_t mipLevels, uint32_t arrayLayers)
 {
 	//--CREATE IMAGE
 	// Image creation info
@@ -1357,8 +2461,8 @@ VkImage VkRenderer::createImage(uint32_t width, uint32_t height, VkFormat format
 	imageCreateInfo.extent.width = width;
 	imageCreateInfo.extent.height = height;
 	imageCreateInfo.extent.depth = 1;
-	imageCreateInfo.mipLevels = 1;
-	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.mipLevels = mipLevels;
+	imageCreateInfo.arrayLayers = arrayLayers;
 	imageCreateInfo.format = format;
 	imageCreateInfo.tiling = tiling;
 	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1389,24 +2493,22 @@ VkImage VkRenderer::createImage(uint32_t width, uint32_t height, VkFormat format
 	return image;
 }
 
-VkImageView VkRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView VkRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels,
+	VkImageViewType viewType, uint32_t layerCount, VkComponentMapping components)
 {
 	VkImageViewCreateInfo viewCreateInfo = {};
 	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewCreateInfo.image = image;
-	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.viewType = viewType;
 	viewCreateInfo.format = format;
-	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components = components;						// identity unless given
 	
 	//subresources : allow the view to view only a part of an image
 	viewCreateInfo.subresourceRange.aspectMask = aspectFlags;
 	viewCreateInfo.subresourceRange.baseMipLevel = 0; 
-	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.levelCount = mipLevels;
 	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
-	viewCreateInfo.subresourceRange.layerCount = 1;
+	viewCreateInfo.subresourceRange.layerCount = layerCount;
 
 	//create image view and return it
 	VkImageView imageView;
@@ -1416,13 +2518,31 @@ VkImageView VkRenderer::createImageView(VkImage image, VkFormat format, VkImageA
 	return imageView;
 }
 
+std::vector<uint32_t> VkRenderer::loadSpirv(const std::string& fileName)
+{
+	// precompiled .spv is read as is, GLSL sources go through the compiler and its cache
+	std::vector<uint32_t> code;
+	if (fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".spv") == 0)
+	{
+		std::vector<char> bytes = readFile(fileName);
+		code.resize(bytes.size() / sizeof(uint32_t));
+		memcpy(code.data(), bytes.data(), code.size() * sizeof(uint32_t));
+	}
+	else
+	{
+		code = shaderCompiler->getSpirv(fileName);
+	}
+	return code;
+}
+
 VkShaderModule VkRenderer::createShaderModule(const std::string& fileName)
 {
-	auto code = readFile(fileName);
+	std::vector<uint32_t> code = loadSpirv(fileName);
+
 	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
 	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCreateInfo.codeSize = code.size();
-	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); //to cast type of pointer data it uses REINTERPRET keywoard instead of STATIC
+	shaderModuleCreateInfo.codeSize = code.size() * sizeof(uint32_t);
+	shaderModuleCreateInfo.pCode = code.data();
 
 	VkShaderModule shaderModule;
 	VkResult result = vkCreateShaderModule(device.logical, &shaderModuleCreateInfo, nullptr, &shaderModule);
@@ -1431,68 +2551,628 @@ VkShaderModule VkRenderer::createShaderModule(const std::string& fileName)
 	return shaderModule;
 }
 
-size_t VkRenderer::createTextureImage(std::string fileName)
+size_t VkRenderer::createComputePipeline(const std::string& fileName)
 {
-	int width, height;
-	VkDeviceSize size;
+	// -- PIPELINE LAYOUT --
+	// reflected from the shader, pipelines declaring the same sets share the layouts
+	ShaderReflection reflection(loadSpirv(fileName));
+	if (reflection.getStage() != VK_SHADER_STAGE_COMPUTE_BIT)
+	{
+		throw std::runtime_error(fileName + " is not a compute shader!");
+	}
+	ShaderLayout layout = ShaderReflection::mergeLayouts({ &reflection });
 
-	stbi_uc* image = loadTextureFile(fileName, &width, &height, &size);
+	ComputePipeline computePipeline = {};
+	for (const std::vector<VkDescriptorSetLayoutBinding>& set : layout.sets)
+	{
+		computePipeline.setLayouts.push_back(layoutCache->getSetLayout(set));
+	}
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	if (layout.pushConstantRange.size > 0) pushConstantRanges.push_back(layout.pushConstantRange);
+	computePipeline.layout = layoutCache->getPipelineLayout(computePipeline.setLayouts, pushConstantRanges);
 
-	//Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingBuffer;
-	VkDeviceMemory imageStagingBufferMemory;
+	computePipeline.pipeline = buildComputePipeline(fileName, computePipeline.layout, pipelineCache->getCache());
+	computePipeline.fileName = fileName;
 
-	createBuffer(device, size, 
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-		&imageStagingBuffer, &imageStagingBufferMemory);
+	computePipelines.push_back(computePipeline);
+	return computePipelines.size() - 1;
+}
 
-	// copy image data to staging buffer
-	void* data;
-	vkMapMemory(device.logical, imageStagingBufferMemory, 0, size, 0, &data);
-	memcpy(data, image, static_cast<size_t>(size));
-	vkUnmapMemory(device.logical, imageStagingBufferMemory);
+VkPipeline VkRenderer::buildComputePipeline(const std::string& fileName, VkPipelineLayout layout, VkPipelineCache cache)
+{
+	VkShaderModule computeShaderModule = createShaderModule(fileName);
+
+	VkPipelineShaderStageCreateInfo computeInfo = {};
+	computeInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeInfo.module = computeShaderModule;
+	computeInfo.pName = "main";
+
+	// -- COMPUTE PIPELINE CREATION --
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = computeInfo;
+	pipelineInfo.layout = layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(device.logical, cache, 1, &pipelineInfo, nullptr, &pipeline);
+
+	// module is only needed while the pipeline is created
+	vkDestroyShaderModule(device.logical, computeShaderModule, nullptr);
+	checkResult(result, "Failed to create a compute pipeline");
+
+	return pipeline;
+}
+
+size_t VkRenderer::createTextureImage(std::string fileName, bool srgb)
+{
+	// pre-compressed textures skip decoding and mip generation
+	if (KtxTexture::isKtxFile(fileName)) return createKtxTextureImage(fileName);
+	if (hasFileExtension(fileName, TEXTURE_BLOB_EXTENSION)) return createBlobTextureImage(fileName);
 
-	stbi_image_free(image);
+	return createDecodedTextureImage({ decodeTextureFile(fileName, srgb) });
+}
+
+size_t VkRenderer::createDecodedTextureImage(const std::vector<DecodedTexture>& layers)
+{
+	uint32_t width = static_cast<uint32_t>(layers[0].width);
+	uint32_t height = static_cast<uint32_t>(layers[0].height);
+	uint32_t layerCount = static_cast<uint32_t>(layers.size());
+	VkFormat format = layers[0].format;
+
+	// layers the staging buffer had no room for when they were decoded share a buffer of their own
+	// copy offsets must be multiples of 4, which R8 and R8G8 layer sizes need not be
+	auto alignedLayerSize = [](VkDeviceSize size) { return (size + 3) & ~VkDeviceSize(3); };
+	VkDeviceSize ownSize = 0;
+	for (const DecodedTexture& texture : layers)
+	{
+		if (texture.staging.data == nullptr) ownSize += alignedLayerSize(texture.size);
+	}
+	VkBuffer ownStagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory ownStagingBufferMemory = VK_NULL_HANDLE;
+	char* ownData = nullptr;
+	if (ownSize > 0)
+	{
+		createBuffer(device, ownSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&ownStagingBuffer, &ownStagingBufferMemory);
+		void* data;
+		vkMapMemory(device.logical, ownStagingBufferMemory, 0, ownSize, 0, &data);
+		ownData = static_cast<char*>(data);
+	}
+
+	// decoded straight into the staging buffer, copied from there as is
+	std::vector<VkBufferImageCopy> stagedRegions;
+	std::vector<VkBufferImageCopy> ownRegions;
+	VkDeviceSize ownOffset = 0;
+	for (uint32_t layer = 0; layer < layerCount; layer++)
+	{
+		const DecodedTexture& texture = layers[layer];
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = layer;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { width, height, 1 };
+
+		if (texture.staging.data != nullptr)
+		{
+			stagingBuffer->flush(texture.staging);
+			region.bufferOffset = texture.staging.offset;
+			stagedRegions.push_back(region);
+		}
+		else
+		{
+			memcpy(ownData + ownOffset, texture.pixels, static_cast<size_t>(texture.size));
+			region.bufferOffset = ownOffset;
+			ownRegions.push_back(region);
+			ownOffset += alignedLayerSize(texture.size);
+		}
+	}
+	if (ownData != nullptr) vkUnmapMemory(device.logical, ownStagingBufferMemory);
+
+	// full mip chain blitted on the GPU, only if the format can be linearly filtered as a blit source
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(device.physical, format, &formatProperties);
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	bool canBlit = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+	uint32_t mipLevels = canBlit ? mipLevelCount(width, height) : 1;
 
 	// create image to hold final texture
 	VkImage texImage;
 	VkDeviceMemory texImageMem;
 	texImage = createImage(width, height, 
-		VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, 
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMem);
+		format, VK_IMAGE_TILING_OPTIMAL, 
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMem, mipLevels, layerCount);
 
 	//ensuring img is on VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL before copying the buffer
-	transitionImageLayout(device.logical, graphicsQueue, graphicsCommandPool, texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	copyImageBuffer(device.logical, graphicsQueue, graphicsCommandPool, imageStagingBuffer, texImage, width, height);
-	//transition iamge to be shader readable for frag usage
-	transitionImageLayout(device.logical, graphicsQueue, graphicsCommandPool, texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	transitionImageLayout(device.logical, graphicsQueue, graphicsCommandPool, texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, layerCount);
+
+	VkCommandBuffer transferCmdBuffer = beginCommandBuffer(device.logical, graphicsCommandPool);
+	if (!stagedRegions.empty())
+	{
+		vkCmdCopyBufferToImage(transferCmdBuffer, stagingBuffer->getBuffer(), texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(stagedRegions.size()), stagedRegions.data());
+	}
+	if (!ownRegions.empty())
+	{
+		vkCmdCopyBufferToImage(transferCmdBuffer, ownStagingBuffer, texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(ownRegions.size()), ownRegions.data());
+	}
+	endAndSubmitCommandBuffer(device.logical, graphicsCommandPool, graphicsQueue, transferCmdBuffer);
+
+	//fill the other levels from level 0, leaves all of them shader readable for frag usage
+	generateMipmaps(device.logical, graphicsQueue, graphicsCommandPool, texImage, width, height, mipLevels, layerCount);
 
 	// add texturedata to vector for ref
 	textureImages.push_back(texImage);
 	textureImageMemory.push_back(texImageMem);
+	textureMipLevels.push_back(mipLevels);
+	textureFormats.push_back(format);
+	textureLayerCounts.push_back(layerCount);
 
-	// clean staging buff
-	vkDestroyBuffer(device.logical, imageStagingBuffer, nullptr);
-	vkFreeMemory(device.logical, imageStagingBufferMemory, nullptr);
+	// the copy has completed, staging ranges and own buffer can go
+	if (ownStagingBuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(device.logical, ownStagingBuffer, nullptr);
+		vkFreeMemory(device.logical, ownStagingBufferMemory, nullptr);
+	}
+	for (const DecodedTexture& texture : layers)
+	{
+		releaseDecodedTexture(texture);
+	}
 
 	//return index of new text iamge
 	return textureImages.size() - 1;
 }
 
-size_t VkRenderer::createTexture(std::string fileName)
+size_t VkRenderer::createKtxTextureImage(const std::string& fileName)
+{
+	KtxTexture texture("Textures/" + fileName);
+	return uploadTextureImage(fileName, texture.getFormat(), texture.getWidth(), texture.getHeight(),
+		texture.getLevels(), texture.getData(), texture.getDataSize());
+}
+
+size_t VkRenderer::createBlobTextureImage(const std::string& fileName)
+{
+	MappedFile file("Textures/" + fileName);
+	const char* data = checkAssetBlob(file.getData(), file.getSize(), AssetType::Texture, fileName);
+
+	const char* tables = file.getData() + sizeof(AssetBlobHeader);
+	const TextureBlobHeader* header = reinterpret_cast<const TextureBlobHeader*>(tables);
+	const TextureBlobLevel* blobLevels = reinterpret_cast<const TextureBlobLevel*>(tables + sizeof(TextureBlobHeader));
+	const AssetBlobHeader* blobHeader = reinterpret_cast<const AssetBlobHeader*>(file.getData());
+	VkDeviceSize dataSize = blobHeader->dataSize;
+	if (sizeof(AssetBlobHeader) + sizeof(TextureBlobHeader) > blobHeader->headerSize ||
+		sizeof(AssetBlobHeader) + sizeof(TextureBlobHeader) + header->levelCount * sizeof(TextureBlobLevel) > blobHeader->headerSize)
+	{
+		throw std::runtime_error("Texture blob header is truncated! (" + fileName + ")");
+	}
+
+	// extents, sizes and ranges of the levels are checked by the upload, the same as for KTX2 files
+	std::vector<TextureLevel> levels(header->levelCount);
+	for (uint32_t i = 0; i < header->levelCount; i++)
+	{
+		levels[i] = { blobLevels[i].offset, blobLevels[i].size, blobLevels[i].width, blobLevels[i].height };
+	}
+
+	// straight from the mapped file into staging
+	return uploadTextureImage(fileName, static_cast<VkFormat>(header->format), header->width, header->height, levels, data, dataSize);
+}
+
+size_t VkRenderer::uploadTextureImage(const std::string& fileName, VkFormat format, uint32_t width, uint32_t height,
+	const std::vector<TextureLevel>& levels, const void* levelData, VkDeviceSize dataSize)
+{
+	// no fallback, the data is only valid in the format it was baked in
+	try {
+		chooseSupportedFormat({ format }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	}
+	catch (const std::runtime_error&) {
+		throw std::runtime_error("Texture format of " + fileName + " is not supported by the device!");
+	}
+
+	// -- VALIDATE --
+	// every level is checked before anything is created. Copies use the row pitch the format implies (bufferRowLength 0),
+	// so each level has to be its mip extent of tightly packed blocks
+	VkDeviceSize halfSize = STREAMING_WINDOW_SIZE / 2;
+	uint32_t blockWidth, blockHeight;
+	formatBlockExtent(format, &blockWidth, &blockHeight);
+	uint32_t blockSize = formatBlockSize(format);
+	uint32_t mipLevels = static_cast<uint32_t>(levels.size());
+	if (mipLevels == 0 || width == 0 || height == 0)
+	{
+		throw std::runtime_error("Texture " + fileName + " has no image data!");
+	}
+	if (mipLevels > mipLevelCount(width, height))
+	{
+		throw std::runtime_error("Texture " + fileName + " has more levels than its extent allows!");
+	}
+	if (blockSize == 0)
+	{
+		throw std::runtime_error("Texture format of " + fileName + " has an unknown block size!");
+	}
+	std::vector<VkDeviceSize> rowSizes(mipLevels);
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		const TextureLevel& level = levels[i];
+		if (level.width != std::max(width >> i, 1u) || level.height != std::max(height >> i, 1u))
+		{
+			throw std::runtime_error("Texture level " + std::to_string(i) + " of " + fileName + " doesn't have the extent of its mip level!");
+		}
+		if (level.size > dataSize || level.offset > dataSize - level.size)
+		{
+			throw std::runtime_error("Texture level " + std::to_string(i) + " of " + fileName + " is out of the file!");
+		}
+		VkDeviceSize blockRows = (level.height + blockHeight - 1) / blockHeight;
+		VkDeviceSize blockColumns = (level.width + blockWidth - 1) / blockWidth;
+		rowSizes[i] = blockColumns * blockSize;
+		if (level.size != blockRows * rowSizes[i])
+		{
+			throw std::runtime_error("Texture level " + std::to_string(i) + " of " + fileName + " doesn't match its format and extent!");
+		}
+		if (rowSizes[i] > halfSize)
+		{
+			throw std::runtime_error("Texture level " + std::to_string(i) + " of " + fileName + " can't be split into rows for streaming!");
+		}
+	}
+
+	VkDeviceMemory texImageMem;
+	VkImage texImage = createImage(width, height,
+		format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMem, mipLevels);
+
+	// the window comes from the shared staging buffer, or is a buffer of its own when that is busy
+	StagingAllocation window;
+	VkBuffer windowBuffer = stagingBuffer->getBuffer();
+	VkDeviceMemory ownWindowMemory = VK_NULL_HANDLE;
+
+	// two halves alternate: the CPU fills one with tiles while the GPU copies out of the other. Host memory stays at the
+	// window size however large the texture is, the mapped source is only paged in as its tiles are copied
+	struct WindowHalf
+	{
+		StagingAllocation range;
+		VkDeviceSize used = 0;
+		std::vector<VkBufferImageCopy> regions;
+		VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;		// only set while submitted
+		VkFence fence = VK_NULL_HANDLE;
+	};
+	std::array<WindowHalf, 2> halves;
+	size_t current = 0;
+
+	// waits for copies in flight and frees the window, on success and on errors alike
+	auto releaseWindow = [&]()
+	{
+		for (WindowHalf& half : halves)
+		{
+			if (half.cmdBuffer != VK_NULL_HANDLE)
+			{
+				vkWaitForFences(device.logical, 1, &half.fence, VK_TRUE, UINT64_MAX);
+				vkFreeCommandBuffers(device.logical, graphicsCommandPool, 1, &half.cmdBuffer);
+				half.cmdBuffer = VK_NULL_HANDLE;
+			}
+			vkDestroyFence(device.logical, half.fence, nullptr);
+			half.fence = VK_NULL_HANDLE;
+		}
+		if (ownWindowMemory != VK_NULL_HANDLE)
+		{
+			vkUnmapMemory(device.logical, ownWindowMemory);
+			vkDestroyBuffer(device.logical, windowBuffer, nullptr);
+			vkFreeMemory(device.logical, ownWindowMemory, nullptr);
+		}
+		else
+		{
+			stagingBuffer->release(window);
+		}
+		window.data = nullptr;
+	};
+
+	auto waitHalf = [&](WindowHalf& half)
+	{
+		if (half.cmdBuffer == VK_NULL_HANDLE) return;
+		vkWaitForFences(device.logical, 1, &half.fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(device.logical, 1, &half.fence);
+		vkFreeCommandBuffers(device.logical, graphicsCommandPool, 1, &half.cmdBuffer);
+		half.cmdBuffer = VK_NULL_HANDLE;
+		half.regions.clear();
+		half.used = 0;
+	};
+	// submits the copies out of the filled half without waiting, then takes the other half once the GPU is done with it
+	auto submitHalf = [&]()
+	{
+		WindowHalf& half = halves[current];
+		if (half.regions.empty()) return;
+		if (ownWindowMemory == VK_NULL_HANDLE) stagingBuffer->flush(half.range);
+
+		half.cmdBuffer = beginCommandBuffer(device.logical, graphicsCommandPool);
+		vkCmdCopyBufferToImage(half.cmdBuffer, windowBuffer, texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(half.regions.size()), half.regions.data());
+		vkEndCommandBuffer(half.cmdBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &half.cmdBuffer;
+		VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, half.fence);
+		if (result != VK_SUCCESS)
+		{
+			vkFreeCommandBuffers(device.logical, graphicsCommandPool, 1, &half.cmdBuffer);
+			half.cmdBuffer = VK_NULL_HANDLE;
+		}
+		checkResult(result, "Failed to submit a texture tile upload");
+
+		current = (current + 1) % halves.size();
+		waitHalf(halves[current]);
+	};
+
+	const char* source = static_cast<const char*>(levelData);
+	size_t tileCount = 0;
+	try
+	{
+		if (!stagingBuffer->allocate(STREAMING_WINDOW_SIZE, &window))
+		{
+			createBuffer(device, STREAMING_WINDOW_SIZE,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&windowBuffer, &ownWindowMemory);
+			vkMapMemory(device.logical, ownWindowMemory, 0, STREAMING_WINDOW_SIZE, 0, &window.data);
+			window.offset = 0;
+			window.size = STREAMING_WINDOW_SIZE;
+		}
+
+		for (size_t i = 0; i < halves.size(); i++)
+		{
+			halves[i].range = { window.offset + i * halfSize, halfSize, static_cast<char*>(window.data) + i * halfSize };
+
+			VkFenceCreateInfo fenceInfo = {};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			VkResult result = vkCreateFence(device.logical, &fenceInfo, nullptr, &halves[i].fence);
+			checkResult(result, "Failed to create a texture streaming fence");
+		}
+
+		transitionImageLayout(device.logical, graphicsQueue, graphicsCommandPool, texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			const TextureLevel& level = levels[i];
+			uint32_t blockRows = (level.height + blockHeight - 1) / blockHeight;
+			VkDeviceSize rowSize = rowSizes[i];
+
+			// as many whole block rows per tile as fit a window half. Small levels share a half
+			uint32_t rowsPerTile = static_cast<uint32_t>(std::min<VkDeviceSize>(halfSize / rowSize, blockRows));
+			for (uint32_t firstRow = 0; firstRow < blockRows; firstRow += rowsPerTile)
+			{
+				uint32_t rowCount = std::min(rowsPerTile, blockRows - firstRow);
+				VkDeviceSize tileSize = rowCount * rowSize;
+				if (halves[current].used + tileSize > halfSize) submitHalf();
+
+				WindowHalf& half = halves[current];
+				memcpy(static_cast<char*>(half.range.data) + half.used, source + level.offset + firstRow * rowSize, static_cast<size_t>(tileSize));
+
+				// extents past the image edge are clipped, partial blocks there are allowed
+				VkBufferImageCopy region{};
+				region.bufferOffset = half.range.offset + half.used;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = i;
+				region.imageSubresource.baseArrayLayer = 0;
+				region.imageSubresource.layerCount = 1;
+				region.imageOffset = { 0, static_cast<int32_t>(firstRow * blockHeight), 0 };
+				region.imageExtent = { level.width, std::min(rowCount * blockHeight, level.height - firstRow * blockHeight), 1 };
+				half.regions.push_back(region);
+
+				half.used += (tileSize + 15) / 16 * 16;				// keeps copy offsets multiples of the block size and 4
+				tileCount++;
+			}
+		}
+		submitHalf();
+		releaseWindow();
+
+		transitionImageLayout(device.logical, graphicsQueue, graphicsCommandPool, texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+	}
+	catch (...)
+	{
+		// the GPU may still copy into the image, so it only goes once every submitted half is done
+		if (window.data != nullptr) releaseWindow();
+		vkDestroyImage(device.logical, texImage, nullptr);
+		vkFreeMemory(device.logical, texImageMem, nullptr);
+		throw;
+	}
+
+	if (tileCount > mipLevels)
+	{
+		printf("Streamed %s (%.1f MB) in %zu tiles through a %.0f MB window\n", fileName.c_str(), dataSize / (1024.0 * 1024.0), tileCount,
+			STREAMING_WINDOW_SIZE / (1024.0 * 1024.0));
+	}
+
+	textureImages.push_back(texImage);
+	textureImageMemory.push_back(texImageMem);
+	textureMipLevels.push_back(mipLevels);
+	textureFormats.push_back(format);
+	textureLayerCounts.push_back(1);
+
+	return textureImages.size() - 1;
+}
+
+size_t VkRenderer::createTexture(std::string fileName, const SamplerState& sampler, bool srgb)
+{
+	return createTextureFromImage(createTextureImage(fileName, srgb), sampler)[0];
+}
+
+std::vector<size_t> VkRenderer::createTextures(const std::vector<std::string>& fileNames, const SamplerState& sampler, bool srgb,
+	const aiScene* scene)
 {
-	int textureImageLoc = createTextureImage(fileName);
-	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	// every file is loaded once, repeated names share its texture
+	std::vector<std::string> uniqueFiles;
+	std::vector<size_t> uniqueSlots(fileNames.size());
+	std::unordered_map<std::string, size_t> slotOfFile;
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		auto inserted = slotOfFile.insert({ fileNames[i], uniqueFiles.size() });
+		if (inserted.second) uniqueFiles.push_back(fileNames[i]);
+		uniqueSlots[i] = inserted.first->second;
+	}
+
+	struct PendingDecode
+	{
+		size_t slot;
+		std::future<DecodedTexture> decoded;
+	};
+	struct PackableTexture
+	{
+		size_t slot;
+		DecodedTexture texture;
+		bool uploaded;
+	};
+
+	auto loadStart = std::chrono::steady_clock::now();
+	std::vector<size_t> slotTextures(uniqueFiles.size());
+	std::vector<size_t> decodeSlots;
+	std::vector<size_t> precompressedSlots;
+	for (size_t slot = 0; slot < uniqueFiles.size(); slot++)
+	{
+		// pre-compressed files need no decoding, they are uploaded while the workers decode the rest
+		bool precompressed = KtxTexture::isKtxFile(uniqueFiles[slot]) || hasFileExtension(uniqueFiles[slot], TEXTURE_BLOB_EXTENSION);
+		(precompressed ? precompressedSlots : decodeSlots).push_back(slot);
+	}
+
+	// a few decodes per worker in flight, so decoded images waiting for upload don't pile up in memory
+	size_t maxInFlight = threadPool->getThreadCount() * 2;
+	size_t nextDecode = 0;
+	std::vector<PendingDecode> pendingDecodes;
+	std::vector<PackableTexture> packable;						// decoded, waiting for the rest of their extent
+	size_t arrayImageCount = 0;
+	size_t packedCount = 0;
+	auto submitDecodes = [&]()
+	{
+		while (nextDecode < decodeSlots.size() && pendingDecodes.size() < maxInFlight)
+		{
+			size_t slot = decodeSlots[nextDecode++];
+			std::string fileName = uniqueFiles[slot];
+			pendingDecodes.push_back({ slot, threadPool->submit([this, fileName, srgb, scene]()
+			{
+				return scene != nullptr && fileName[0] == '*' ? decodeEmbeddedTexture(scene, fileName, srgb) : decodeTextureFile(fileName, srgb);
+			}) });
+		}
+	};
+
+	std::exception_ptr error;
+	try
+	{
+		submitDecodes();
+		for (size_t slot : precompressedSlots)
+		{
+			slotTextures[slot] = createTexture(uniqueFiles[slot], sampler, srgb);
+		}
+
+		// upload in completion order: whichever decode is done first, otherwise wait for the oldest
+		while (!pendingDecodes.empty())
+		{
+			auto ready = std::find_if(pendingDecodes.begin(), pendingDecodes.end(), [](const PendingDecode& pending)
+			{
+				return pending.decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			});
+			if (ready == pendingDecodes.end()) ready = pendingDecodes.begin();
+
+			size_t slot = ready->slot;
+			DecodedTexture texture = ready->decoded.get();
+			pendingDecodes.erase(ready);
+			submitDecodes();
+
+			if (texture.width <= TEXTURE_ARRAY_MAX_EXTENT && texture.height <= TEXTURE_ARRAY_MAX_EXTENT)
+			{
+				packable.push_back({ slot, texture, false });
+			}
+			else
+			{
+				slotTextures[slot] = createTextureFromImage(createDecodedTextureImage({ texture }), sampler)[0];
+			}
+		}
+
+		// textures of the same format and extent become layers of one array image and share its descriptor set
+		std::map<std::tuple<VkFormat, int, int>, std::vector<size_t>> extentGroups;		// format, extent -> indices into packable
+		for (size_t i = 0; i < packable.size(); i++)
+		{
+			const DecodedTexture& texture = packable[i].texture;
+			extentGroups[std::make_tuple(texture.format, texture.width, texture.height)].push_back(i);
+		}
+		for (const auto& group : extentGroups)
+		{
+			std::vector<DecodedTexture> layers;
+			for (size_t i : group.second)
+			{
+				layers.push_back(packable[i].texture);
+				packable[i].uploaded = true;
+			}
+			std::vector<size_t> layerTextures = createTextureFromImage(createDecodedTextureImage(layers), sampler);
+			for (size_t layer = 0; layer < group.second.size(); layer++)
+			{
+				slotTextures[packable[group.second[layer]].slot] = layerTextures[layer];
+			}
+			if (layers.size() > 1)
+			{
+				arrayImageCount++;
+				packedCount += layers.size();
+			}
+		}
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	// decodes still in flight after a failure are waited for, so their pixels can be released
+	for (const PackableTexture& texture : packable)
+	{
+		if (!texture.uploaded) releaseDecodedTexture(texture.texture);
+	}
+	for (PendingDecode& pending : pendingDecodes)
+	{
+		try
+		{
+			releaseDecodedTexture(pending.decoded.get());
+		}
+		catch (...)
+		{
+		}
+	}
+	if (error) std::rethrow_exception(error);
+
+	printf("Loaded %zu textures (%zu decoded on %zu threads, %zu packed into %zu array images) in %.2f ms\n", uniqueFiles.size(), decodeSlots.size(),
+		threadPool->getThreadCount(), packedCount, arrayImageCount, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+
+	std::vector<size_t> textureIds(fileNames.size());
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		textureIds[i] = slotTextures[uniqueSlots[i]];
+	}
+	return textureIds;
+}
+
+std::vector<size_t> VkRenderer::createTextureFromImage(size_t textureImageLoc, const SamplerState& sampler)
+{
+	// always an array view, the shaders sample every texture as a sampler2DArray
+	uint32_t layerCount = textureLayerCounts[textureImageLoc];
+	VkFormat format = textureFormats[textureImageLoc];
+	VkImageView imageView = createImageView(textureImages[textureImageLoc], format, VK_IMAGE_ASPECT_COLOR_BIT, textureMipLevels[textureImageLoc],
+		VK_IMAGE_VIEW_TYPE_2D_ARRAY, layerCount, textureSwizzle(format));
 	textureImageViews.push_back(imageView);
 
-	int descriptorLoc = createTextureDescriptor(imageView);
+	size_t descriptorLoc = createTextureDescriptor(imageView, samplerCache->getSampler(sampler));
 
-	return descriptorLoc;
+	std::vector<size_t> textureIds;
+	for (uint32_t layer = 0; layer < layerCount; layer++)
+	{
+		textureIds.push_back(textures.size());
+		textures.push_back({ descriptorLoc, layer });
+	}
+	return textureIds;
 }
 
-size_t VkRenderer::createTextureDescriptor(VkImageView textureImage)
+size_t VkRenderer::createTextureDescriptor(VkImageView textureImage, VkSampler sampler)
 {
 	// Descriptor set alloc info
 	VkDescriptorSet descriptorSet;
@@ -1509,7 +3189,7 @@ size_t VkRenderer::createTextureDescriptor(VkImageView textureImage)
 	VkDescriptorImageInfo imageInfo{};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	imageInfo.imageView = textureImage;
-	imageInfo.sampler = textureSampler;
+	imageInfo.sampler = sampler;
 
 	// descripptor write info
 	VkWriteDescriptorSet descriptorWrite{};
@@ -1528,26 +3208,551 @@ size_t VkRenderer::createTextureDescriptor(VkImageView textureImage)
 	return samplerDescriptorSets.size() - 1;
 }
 
-void VkRenderer::createModel(std::string modelFile)
+size_t VkRenderer::createModel(const std::string& modelFile)
 {
+	std::vector<Mesh*> modelMeshes;
+	if (hasFileExtension(modelFile, MESH_BLOB_EXTENSION))
+	{
+		modelMeshes = loadMeshBlob("Models/" + modelFile);
+	}
+	else
+	{
+		// imported models are cached as mesh blobs, re-imported whenever the source or the vertex layout changed
+		// named after the path below Models/, separators and '%' escaped so models of the same name in different folders don't collide
+		uint64_t sourceHash = hashModelSource(modelFile);
+		std::string cacheName;
+		for (char c : std::filesystem::path(modelFile).lexically_normal().generic_string())
+		{
+			cacheName += c == '/' ? "%2F" : c == '%' ? "%25" : std::string(1, c);
+		}
+		std::string cachePath = std::string(MESH_CACHE_DIRECTORY) + "/" + cacheName + MESH_BLOB_EXTENSION;
+		bool loaded = false;
+		if (isMeshCacheCurrent(cachePath, sourceHash))
+		{
+			// a cache that fails to load is written again from the source
+			try
+			{
+				modelMeshes = loadMeshBlob(cachePath);
+				loaded = true;
+			}
+			catch (const std::runtime_error& e)
+			{
+				printf("Mesh cache %s is unusable, importing %s again: %s\n", cachePath.c_str(), modelFile.c_str(), e.what());
+			}
+		}
+		if (!loaded)
+		{
+			modelMeshes = importModel(modelFile, cachePath, sourceHash);
+		}
+	}
+	meshes.insert(meshes.end(), modelMeshes.begin(), modelMeshes.end());
+	models.push_back(Model(modelMeshes));
+	return models.size() - 1;
+}
+
+uint64_t VkRenderer::hashModelSource(const std::string& fileName)
+{
+	// only the file itself, external buffers of a .gltf are not covered
+	MappedFile source("Models/" + fileName);
+	uint64_t hash = hashFnv1a(source.getData(), source.getSize());
+	hash = hashFnv1a(&vertexStride, sizeof(vertexStride), hash);
+	hash = hashFnv1a(&MESH_OPTIMIZER_VERSION, sizeof(MESH_OPTIMIZER_VERSION), hash);
+	for (const VkVertexInputAttributeDescription& attribute : vertexAttributes)
+	{
+		hash = hashFnv1a(&attribute.location, sizeof(attribute.location), hash);
+		hash = hashFnv1a(&attribute.format, sizeof(attribute.format), hash);
+		hash = hashFnv1a(&attribute.offset, sizeof(attribute.offset), hash);
+	}
+	return hash;
 }
 
-stbi_uc* VkRenderer::loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize)
+bool VkRenderer::isMeshCacheCurrent(const std::string& cachePath, uint64_t sourceHash)
+{
+	if (!std::filesystem::exists(cachePath)) return false;
+
+	// anything unexpected counts as a miss, the cache is simply written again
+	MappedFile file(cachePath);
+	if (file.getSize() < sizeof(AssetBlobHeader) + sizeof(MeshBlobHeader)) return false;
+	const AssetBlobHeader* blobHeader = reinterpret_cast<const AssetBlobHeader*>(file.getData());
+	const MeshBlobHeader* header = reinterpret_cast<const MeshBlobHeader*>(file.getData() + sizeof(AssetBlobHeader));
+	return blobHeader->magic == ASSET_BLOB_MAGIC && blobHeader->version == ASSET_BLOB_VERSION && blobHeader->type == AssetType::Mesh &&
+		header->sourceHash == sourceHash;
+}
+
+std::vector<Mesh*> VkRenderer::importModel(const std::string& fileName, const std::string& cachePath, uint64_t sourceHash)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// same processing as AssetBaker: triangles and vertices reordered by optimizeMesh, then packed into settings.vertexLayout
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile("Models/" + fileName,
+		aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_PreTransformVertices |
+		aiProcess_SortByPType | aiProcess_FlipUVs);
+	if (scene == nullptr)
+	{
+		throw std::runtime_error("Failed to import a model file! (" + fileName + ": " + importer.GetErrorString() + ")");
+	}
+
+	struct ImportedMesh
+	{
+		const aiMesh* source;
+		VkDeviceSize vertexSize;
+		VkDeviceSize indexSize;
+		StagingAllocation staging;			// vertices followed by indices, empty when the staging buffer was full
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::string texture;
+		glm::vec3 color;					// material colour for meshes without vertex colours
+		MeshOptimizeStats stats;
+		PositionQuantization quantization;
+		VkIndexType indexType;
+	};
+	std::vector<ImportedMesh> imported;
+	imported.reserve(scene->mNumMeshes);
+	std::vector<std::string> textureNames;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* source = scene->mMeshes[m];
+		if (source->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) continue;		// points and lines are split off by SortByPType
+
+		ImportedMesh mesh = {};
+		mesh.source = source;
+		mesh.vertexSize = static_cast<VkDeviceSize>(source->mNumVertices) * sizeof(Vertex);
+		mesh.indexSize = static_cast<VkDeviceSize>(source->mNumFaces) * 3 * sizeof(uint32_t);
+
+		// textures are looked up in Textures/ by file name, embedded ones ("*0" in glb files) keep their name and decode from the scene
+		const aiMaterial* material = scene->mMaterials[source->mMaterialIndex];
+		aiString texturePath;
+		if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0 && material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) == AI_SUCCESS)
+		{
+			std::string path = texturePath.C_Str();
+			mesh.texture = !path.empty() && path[0] == '*' ? path : path.substr(path.find_last_of("/\\") + 1);
+			textureNames.push_back(mesh.texture);
+		}
+		aiColor4D diffuse(1.0f, 1.0f, 1.0f, 1.0f);
+		material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+		mesh.color = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+
+		imported.push_back(std::move(mesh));
+	}
+
+	// each mesh converts on a worker, into its staging range when there is room
+	std::vector<std::future<void>> conversions;
+	for (ImportedMesh& mesh : imported)
+	{
+		stagingBuffer->allocate(mesh.vertexSize + mesh.indexSize, &mesh.staging);
+		conversions.push_back(threadPool->submit([&mesh, vertexLayout = settings.vertexLayout]()
+		{
+			const aiMesh* source = mesh.source;
+			Vertex* vertices = static_cast<Vertex*>(mesh.staging.data);
+			if (vertices == nullptr)
+			{
+				mesh.vertices.resize(source->mNumVertices);
+				mesh.indices.resize(static_cast<size_t>(source->mNumFaces) * 3);
+				vertices = mesh.vertices.data();
+			}
+			uint32_t* indices = mesh.staging.data != nullptr ?
+				reinterpret_cast<uint32_t*>(static_cast<char*>(mesh.staging.data) + mesh.vertexSize) : mesh.indices.data();
+
+			for (unsigned int v = 0; v < source->mNumVertices; v++)
+			{
+				Vertex& vertex = vertices[v];
+				vertex.position = glm::vec3(source->mVertices[v].x, source->mVertices[v].y, source->mVertices[v].z);
+				vertex.color = source->HasVertexColors(0) ?
+					glm::vec3(source->mColors[0][v].r, source->mColors[0][v].g, source->mColors[0][v].b) : mesh.color;
+				vertex.coordinates = source->HasTextureCoords(0) ?
+					glm::vec2(source->mTextureCoords[0][v].x, source->mTextureCoords[0][v].y) : glm::vec2(0.0f);
+			}
+			for (unsigned int f = 0; f < source->mNumFaces; f++)
+			{
+				const aiFace& face = source->mFaces[f];
+				indices[f * 3 + 0] = face.mIndices[0];
+				indices[f * 3 + 1] = face.mIndices[1];
+				indices[f * 3 + 2] = face.mIndices[2];
+			}
+
+			// reordered where the data already is, the cache and the GPU get the optimised order
+			size_t indexCount = static_cast<size_t>(source->mNumFaces) * 3;
+			mesh.stats = optimizeMesh(vertices, source->mNumVertices, sizeof(Vertex), indices, indexCount);
+
+			// packed in place as well. Staged indices move down to right behind the smaller vertex stream
+			uint32_t stride = packVertices(vertices, source->mNumVertices, vertexLayout, &mesh.quantization);
+			mesh.indexType = packIndices(indices, indexCount, source->mNumVertices);
+			mesh.vertexSize = static_cast<VkDeviceSize>(source->mNumVertices) * stride;
+			mesh.indexSize = static_cast<VkDeviceSize>(indexCount) * indexTypeSize(mesh.indexType);
+			if (mesh.staging.data != nullptr)
+			{
+				memmove(static_cast<char*>(mesh.staging.data) + mesh.vertexSize, indices, static_cast<size_t>(mesh.indexSize));
+			}
+		}));
+	}
+
+	// the workers must be done with the meshes before anything is thrown
+	std::vector<size_t> texIds;
+	std::exception_ptr error;
+	try
+	{
+		if (!textureNames.empty()) texIds = createTextures(textureNames, SamplerState(), false, scene);
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+	for (std::future<void>& conversion : conversions)
+	{
+		try
+		{
+			conversion.get();
+		}
+		catch (...)
+		{
+			if (!error) error = std::current_exception();
+		}
+	}
+	if (error)
+	{
+		for (const ImportedMesh& mesh : imported)
+		{
+			if (mesh.staging.data != nullptr) stagingBuffer->release(mesh.staging);
+		}
+		std::rethrow_exception(error);
+	}
+
+	// every staged mesh is copied by the same command buffer
+	std::vector<Mesh*> importedMeshes;
+	size_t textureIndex = 0;
+	size_t vertexCount = 0, triangleCount = 0;
+	double missesBefore = 0.0, missesAfter = 0.0;
+	VkCommandBuffer transferCmdBuffer = beginCommandBuffer(device.logical, graphicsCommandPool);
+	for (ImportedMesh& mesh : imported)
+	{
+		size_t texId = mesh.texture.empty() ? 0 : texIds[textureIndex++];
+		size_t meshVertexCount = mesh.source->mNumVertices;
+		size_t meshIndexCount = static_cast<size_t>(mesh.source->mNumFaces) * 3;
+
+		Mesh* newMesh;
+		if (mesh.staging.data != nullptr)
+		{
+			stagingBuffer->flush(mesh.staging);
+			newMesh = new Mesh(device, transferCmdBuffer, stagingBuffer->getBuffer(),
+				mesh.staging.offset, mesh.vertexSize, meshVertexCount,
+				mesh.staging.offset + mesh.vertexSize, mesh.indexSize, meshIndexCount, texId);
+		}
+		else
+		{
+			newMesh = new Mesh(device, graphicsQueue, graphicsCommandPool,
+				mesh.vertices.data(), mesh.vertexSize, meshVertexCount,
+				mesh.indices.data(), mesh.indexSize, meshIndexCount, texId);
+		}
+		newMesh->setIndexType(mesh.indexType);
+		newMesh->setPositionQuantization(mesh.quantization);
+		newMesh->setFeatures(mesh.texture.empty() ? PIPELINE_FEATURE_VERTEX_COLOR : PIPELINE_FEATURE_TEXTURED);
+		importedMeshes.push_back(newMesh);
+
+		vertexCount += meshVertexCount;
+		triangleCount += meshIndexCount / 3;
+		missesBefore += double(mesh.stats.acmrBefore) * mesh.stats.triangleCount;
+		missesAfter += double(mesh.stats.acmrAfter) * mesh.stats.triangleCount;
+	}
+	endAndSubmitCommandBuffer(device.logical, graphicsCommandPool, graphicsQueue, transferCmdBuffer);
+
+	// -- STORE --
+	// streams in the layout they were uploaded with, so loading the cache is a mapping and a copy into staging
+	// embedded textures only exist in the source file, models using them are imported every time
+	bool cacheable = !cachePath.empty();
+	for (const ImportedMesh& mesh : imported)
+	{
+		cacheable = cacheable && mesh.texture.size() < ASSET_BLOB_NAME_SIZE && (mesh.texture.empty() || mesh.texture[0] != '*');
+	}
+	if (cacheable)
+	{
+		MeshBlobHeader header = {};
+		header.vertexStride = vertexStride;
+		header.attributeCount = static_cast<uint32_t>(vertexAttributes.size());
+		header.vertexLayout = static_cast<uint32_t>(settings.vertexLayout);
+		header.submeshCount = static_cast<uint32_t>(imported.size());
+		header.sourceHash = sourceHash;
+
+		std::vector<MeshBlobAttribute> attributes;
+		for (const VkVertexInputAttributeDescription& attribute : vertexAttributes)
+		{
+			attributes.push_back({ attribute.location, static_cast<uint32_t>(attribute.format), attribute.offset, 0 });
+		}
+
+		std::vector<MeshBlobSubmesh> submeshes;
+		std::vector<char> data;
+		for (const ImportedMesh& mesh : imported)
+		{
+			const char* vertexData = mesh.staging.data != nullptr ? static_cast<const char*>(mesh.staging.data) : reinterpret_cast<const char*>(mesh.vertices.data());
+			const char* indexData = mesh.staging.data != nullptr ? vertexData + mesh.vertexSize : reinterpret_cast<const char*>(mesh.indices.data());
+
+			MeshBlobSubmesh submesh = {};
+			submesh.vertexCount = mesh.source->mNumVertices;
+			submesh.indexCount = mesh.source->mNumFaces * 3;
+			submesh.indexType = mesh.indexType;
+			submesh.quantization = mesh.quantization;
+			memcpy(submesh.texture, mesh.texture.c_str(), mesh.texture.size() + 1);
+
+			submesh.vertexOffset = alignBlobOffset(data.size());
+			data.resize(submesh.vertexOffset);
+			appendBlob(data, vertexData, static_cast<size_t>(mesh.vertexSize));
+			submesh.indexOffset = alignBlobOffset(data.size());
+			data.resize(submesh.indexOffset);
+			appendBlob(data, indexData, static_cast<size_t>(mesh.indexSize));
+			submeshes.push_back(submesh);
+		}
+
+		std::vector<char> tables;
+		appendBlob(tables, &header);
+		appendBlob(tables, attributes.data(), attributes.size());
+		appendBlob(tables, submeshes.data(), submeshes.size());
+
+		// written to a temporary file and renamed, a half written cache would otherwise pass the header check
+		try
+		{
+			std::filesystem::create_directories(MESH_CACHE_DIRECTORY);
+			writeAssetBlob(cachePath + ".tmp", AssetType::Mesh, tables, data);
+			std::filesystem::rename(cachePath + ".tmp", cachePath);
+		}
+		catch (const std::exception& e)
+		{
+			printf("Mesh cache: failed to write %s (%s)\n", cachePath.c_str(), e.what());
+		}
+	}
+
+	for (const ImportedMesh& mesh : imported)
+	{
+		if (mesh.staging.data != nullptr) stagingBuffer->release(mesh.staging);
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Imported %s: %zu meshes, %zu vertices, %zu triangles in %.0f ms, ACMR %.3f -> %.3f\n", fileName.c_str(), importedMeshes.size(),
+		vertexCount, triangleCount, milliseconds, triangleCount > 0 ? missesBefore / triangleCount : 0.0, triangleCount > 0 ? missesAfter / triangleCount : 0.0);
+	return importedMeshes;
+}
+
+std::vector<Mesh*> VkRenderer::loadMeshBlob(const std::string& fileName)
+{
+	MappedFile file(fileName);
+	const char* data = checkAssetBlob(file.getData(), file.getSize(), AssetType::Mesh, fileName);
+
+	const AssetBlobHeader* blobHeader = reinterpret_cast<const AssetBlobHeader*>(file.getData());
+	const char* tables = file.getData() + sizeof(AssetBlobHeader);
+	const MeshBlobHeader* header = reinterpret_cast<const MeshBlobHeader*>(tables);
+	const MeshBlobAttribute* attributes = reinterpret_cast<const MeshBlobAttribute*>(tables + sizeof(MeshBlobHeader));
+	const MeshBlobSubmesh* submeshes = reinterpret_cast<const MeshBlobSubmesh*>(attributes + header->attributeCount);
+	if (sizeof(AssetBlobHeader) + sizeof(MeshBlobHeader) > blobHeader->headerSize ||
+		reinterpret_cast<const char*>(submeshes + header->submeshCount) > file.getData() + blobHeader->headerSize)
+	{
+		throw std::runtime_error("Mesh blob header is truncated! (" + fileName + ")");
+	}
+
+	// streams are copied as they are, so their layout has to be the one the vertex shader was reflected with
+	bool layoutMatches = header->vertexStride == vertexStride && header->attributeCount == vertexAttributes.size();
+	for (uint32_t i = 0; layoutMatches && i < header->attributeCount; i++)
+	{
+		auto attribute = std::find_if(vertexAttributes.begin(), vertexAttributes.end(),
+			[&](const VkVertexInputAttributeDescription& description) { return description.location == attributes[i].location; });
+		layoutMatches = attribute != vertexAttributes.end() && attribute->format == static_cast<VkFormat>(attributes[i].format) && attribute->offset == attributes[i].offset;
+	}
+	if (!layoutMatches)
+	{
+		throw std::runtime_error("Mesh blob vertex layout doesn't match the vertex shader, bake it again! (" + fileName + ")");
+	}
+
+	// all textures of the model in one batch
+	std::vector<std::string> textures;
+	for (uint32_t i = 0; i < header->submeshCount; i++)
+	{
+		const MeshBlobSubmesh& submesh = submeshes[i];
+		if (submesh.indexType != VK_INDEX_TYPE_UINT16 && submesh.indexType != VK_INDEX_TYPE_UINT32)
+		{
+			throw std::runtime_error("Mesh blob submesh has an unknown index type! (" + fileName + ")");
+		}
+		VkDeviceSize vertexSize = static_cast<VkDeviceSize>(submesh.vertexCount) * header->vertexStride;
+		VkDeviceSize indexSize = static_cast<VkDeviceSize>(submesh.indexCount) * indexTypeSize(static_cast<VkIndexType>(submesh.indexType));
+		if (vertexSize > blobHeader->dataSize || submesh.vertexOffset > blobHeader->dataSize - vertexSize ||
+			indexSize > blobHeader->dataSize || submesh.indexOffset > blobHeader->dataSize - indexSize)
+		{
+			throw std::runtime_error("Mesh blob submesh is out of the file! (" + fileName + ")");
+		}
+
+		std::string texture(submesh.texture, strnlen(submesh.texture, ASSET_BLOB_NAME_SIZE));
+		if (!texture.empty()) textures.push_back(texture);
+	}
+	std::vector<size_t> texIds = createTextures(textures);
+
+	// both streams of a submesh go from the mapping into one staging range, all copies are submitted together
+	std::vector<Mesh*> blobMeshes;
+	std::vector<StagingAllocation> stagedRanges;
+	size_t textureIndex = 0;
+	VkCommandBuffer transferCmdBuffer = beginCommandBuffer(device.logical, graphicsCommandPool);
+	for (uint32_t i = 0; i < header->submeshCount; i++)
+	{
+		const MeshBlobSubmesh& submesh = submeshes[i];
+		VkDeviceSize vertexSize = static_cast<VkDeviceSize>(submesh.vertexCount) * header->vertexStride;
+		VkDeviceSize indexSize = static_cast<VkDeviceSize>(submesh.indexCount) * indexTypeSize(static_cast<VkIndexType>(submesh.indexType));
+
+		std::string texture(submesh.texture, strnlen(submesh.texture, ASSET_BLOB_NAME_SIZE));
+		size_t texId = texture.empty() ? 0 : texIds[textureIndex++];
+
+		Mesh* mesh;
+		StagingAllocation staging;
+		if (stagingBuffer->allocate(vertexSize + indexSize, &staging))
+		{
+			memcpy(staging.data, data + submesh.vertexOffset, static_cast<size_t>(vertexSize));
+			memcpy(static_cast<char*>(staging.data) + vertexSize, data + submesh.indexOffset, static_cast<size_t>(indexSize));
+			stagingBuffer->flush(staging);
+			stagedRanges.push_back(staging);
+
+			mesh = new Mesh(device, transferCmdBuffer, stagingBuffer->getBuffer(),
+				staging.offset, vertexSize, submesh.vertexCount,
+				staging.offset + vertexSize, indexSize, submesh.indexCount, texId);
+		}
+		else
+		{
+			mesh = new Mesh(device, graphicsQueue, graphicsCommandPool,
+				data + submesh.vertexOffset, vertexSize, submesh.vertexCount,
+				data + submesh.indexOffset, indexSize, submesh.indexCount, texId);
+		}
+		mesh->setIndexType(static_cast<VkIndexType>(submesh.indexType));
+		mesh->setPositionQuantization(submesh.quantization);
+		mesh->setFeatures(texture.empty() ? PIPELINE_FEATURE_VERTEX_COLOR : PIPELINE_FEATURE_TEXTURED);
+		blobMeshes.push_back(mesh);
+	}
+	endAndSubmitCommandBuffer(device.logical, graphicsCommandPool, graphicsQueue, transferCmdBuffer);
+
+	for (const StagingAllocation& staging : stagedRanges)
+	{
+		stagingBuffer->release(staging);
+	}
+	return blobMeshes;
+}
+
+DecodedTexture VkRenderer::decodeTextureFile(const std::string& fileName, bool srgb)
 {
 	// Number of channels image uses
 	int channels;
+	DecodedTexture texture;
 
-	// Load pixel data for image
+	// the header tells the channels and output size before anything is decoded
 	std::string fileLoc = "Textures/" + fileName;
-	stbi_uc* image = stbi_load(fileLoc.c_str(), width, height, &channels, STBI_rgb_alpha);
+	if (!stbi_info(fileLoc.c_str(), &texture.width, &texture.height, &channels))
+	{
+		throw std::runtime_error("Failed to load a Texture file! (" + fileName + ")");
+	}
+	texture.format = chooseTextureFormat(channels, srgb, &texture.components);
+	texture.size = static_cast<VkDeviceSize>(texture.width) * texture.height * texture.components;
+
+	// stb_image allocates its output inside the staging range, so each texel is written once and copied by the GPU
+	bool staged = stagingBuffer->allocate(texture.size, &texture.staging);
+	if (staged) setDecodeTarget(texture.staging.data, static_cast<size_t>(texture.size));
+	texture.pixels = stbi_load(fileLoc.c_str(), &texture.width, &texture.height, &channels, texture.components);
+	setDecodeTarget(nullptr, 0);
 
-	if (!image)
+	if (!texture.pixels)
 	{
+		if (staged) stagingBuffer->release(texture.staging);
 		throw std::runtime_error("Failed to load a Texture file! (" + fileName + ")");
 	}
 
-	// Calculate image size using given and known data
-	*imageSize = *width * *height * 4;
+	if (staged && texture.pixels != texture.staging.data)
+	{
+		// output ended up on the heap, e.g. an intermediate buffer of the same size took the range first
+		memcpy(texture.staging.data, texture.pixels, static_cast<size_t>(texture.size));
+		stbi_image_free(texture.pixels);
+		texture.pixels = static_cast<unsigned char*>(texture.staging.data);
+	}
+	return texture;
+}
 
-	return image;
+DecodedTexture VkRenderer::decodeEmbeddedTexture(const aiScene* scene, const std::string& name, bool srgb)
+{
+	const aiTexture* source = scene->GetEmbeddedTexture(name.c_str());
+	if (source == nullptr || source->pcData == nullptr)
+	{
+		throw std::runtime_error("Missing embedded texture! (" + name + ")");
+	}
+
+	int channels;
+	DecodedTexture texture;
+	if (source->mHeight == 0)
+	{
+		// mWidth bytes of an image file, decoded into staging the same way as decodeTextureFile
+		const stbi_uc* data = reinterpret_cast<const stbi_uc*>(source->pcData);
+		int dataSize = static_cast<int>(source->mWidth);
+		if (!stbi_info_from_memory(data, dataSize, &texture.width, &texture.height, &channels))
+		{
+			throw std::runtime_error("Failed to decode an embedded texture! (" + name + ")");
+		}
+		texture.format = chooseTextureFormat(channels, srgb, &texture.components);
+		texture.size = static_cast<VkDeviceSize>(texture.width) * texture.height * texture.components;
+
+		bool staged = stagingBuffer->allocate(texture.size, &texture.staging);
+		if (staged) setDecodeTarget(texture.staging.data, static_cast<size_t>(texture.size));
+		texture.pixels = stbi_load_from_memory(data, dataSize, &texture.width, &texture.height, &channels, texture.components);
+		setDecodeTarget(nullptr, 0);
+
+		if (!texture.pixels)
+		{
+			if (staged) stagingBuffer->release(texture.staging);
+			throw std::runtime_error("Failed to decode an embedded texture! (" + name + ")");
+		}
+		if (staged && texture.pixels != texture.staging.data)
+		{
+			memcpy(texture.staging.data, texture.pixels, static_cast<size_t>(texture.size));
+			stbi_image_free(texture.pixels);
+			texture.pixels = static_cast<unsigned char*>(texture.staging.data);
+		}
+		return texture;
+	}
+
+	// raw texels, mWidth x mHeight of BGRA
+	texture.width = static_cast<int>(source->mWidth);
+	texture.height = static_cast<int>(source->mHeight);
+	texture.format = chooseTextureFormat(4, srgb, &texture.components);
+	texture.size = static_cast<VkDeviceSize>(texture.width) * texture.height * texture.components;
+	bool staged = stagingBuffer->allocate(texture.size, &texture.staging);
+	texture.pixels = staged ? static_cast<unsigned char*>(texture.staging.data) : static_cast<unsigned char*>(malloc(static_cast<size_t>(texture.size)));
+	if (!texture.pixels)
+	{
+		throw std::runtime_error("Failed to allocate an embedded texture! (" + name + ")");
+	}
+	size_t texelCount = static_cast<size_t>(source->mWidth) * source->mHeight;
+	for (size_t i = 0; i < texelCount; i++)
+	{
+		const aiTexel& texel = source->pcData[i];
+		texture.pixels[i * 4 + 0] = texel.r;
+		texture.pixels[i * 4 + 1] = texel.g;
+		texture.pixels[i * 4 + 2] = texel.b;
+		texture.pixels[i * 4 + 3] = texel.a;
+	}
+	return texture;
+}
+
+VkFormat VkRenderer::chooseTextureFormat(int channels, bool srgb, int* components)
+{
+	// smallest sampleable format holding the source channels. RGB has no widely supported 3 byte format and is expanded to RGBA,
+	// which also stays the fallback for the optional sRGB R8 and R8G8 formats
+	VkFormat rgba = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	std::vector<VkFormat> candidates;
+	if (channels == 1) candidates.push_back(srgb ? VK_FORMAT_R8_SRGB : VK_FORMAT_R8_UNORM);
+	if (channels == 2) candidates.push_back(srgb ? VK_FORMAT_R8G8_SRGB : VK_FORMAT_R8G8_UNORM);
+	candidates.push_back(rgba);
+
+	VkFormat format = chooseSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	*components = format == rgba ? 4 : channels;
+	return format;
+}
+
+void VkRenderer::releaseDecodedTexture(const DecodedTexture& texture)
+{
+	if (texture.staging.data != nullptr)
+	{
+		stagingBuffer->release(texture.staging);
+	}
+	else
+	{
+		stbi_image_free(texture.pixels);
+	}
 }
@@ -10,36 +10,77 @@
 #include <vector>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <tuple>
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <filesystem>
 
 #include "stb_image.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
 
 #include "VulkanValidation.h"
 #include "Utilities.h"
 #include "Window.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "RenderGraph.h"
+#include "PipelineCache.h"
+#include "ShaderCompiler.h"
+#include "ThreadPool.h"
+#include "ShaderWatcher.h"
+#include "ShaderReflection.h"
+#include "DescriptorLayoutCache.h"
+#include "PipelineRegistry.h"
+#include "SamplerCache.h"
+#include "KtxTexture.h"
+#include "MappedFile.h"
+#include "StagingBuffer.h"
+#include "AssetBlob.h"
+#include "MeshOptimizer.h"
 
 
 
 class VkRenderer
 {
 public:
-	VkRenderer(const Window& window);
+	VkRenderer(const Window& window, const RendererSettings& settings = RendererSettings());
 	void updateModel(size_t modelId, glm::mat4 newModel);
+	void setMeshFeatures(size_t meshId, PipelineFeatures features);
+	void setLights(const std::vector<Light>& lights, glm::vec3 ambient);		// deferred path only, up to MAX_LIGHTS
+
+	// - Models
+	// Models/<modelFile>: a baked mesh blob, or any format assimp imports (glTF/glb, OBJ...). Returns the model id
+	size_t createModel(const std::string& modelFile);
+	void setModelTransform(size_t modelId, glm::mat4 newModel);
+
+	// - Compute
+	size_t createComputePipeline(const std::string& fileName);
+	VkDescriptorSetLayout getComputeSetLayout(size_t pipelineId, uint32_t set) const { return computePipelines[pipelineId].setLayouts[set]; }
+	void addComputeDispatch(const ComputeDispatch& dispatch) { computeDispatches.push_back(dispatch); }
+	void clearComputeDispatches() { computeDispatches.clear(); }
 	void draw();
+	const FrameTimings& getFrameTimings() const { return frameTimings; }
 	~VkRenderer();
 
 private:
 	GLFWwindow* window;
+	RendererSettings settings;
+	std::string vertexShaderFile;							// scene shaders, G-buffer shaders on the deferred path
+	std::string fragShaderFile;
 	size_t currentFrame = 0;
+	uint64_t frameNumber = 0;								// frames drawn so far
 
 	//Scene objects
 	std::vector<Mesh*> meshes;
 	std::vector<Model> models;
 
 	UboViewProjection uboVP;
+	UboLights uboLights = {};
 
 	// Vulkan Components
 	VkInstance instance;
@@ -49,6 +90,8 @@ private:
 
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
+	VkQueue computeQueue;
+	QueueFamilyIndices queueFamilies;
 
 
 	VkSurfaceKHR surface;
@@ -58,14 +101,46 @@ private:
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	std::vector<VkCommandBuffer> commandBuffers;
 
-	VkImage depthBufferImage;
-	VkDeviceMemory depthBufferImageMemory;
-	VkImageView depthBufferImageView;
+	// Frame graph, owns the depth buffer and all swapchain layout transitions
+	RenderGraph* renderGraph = nullptr;
+	size_t swapChainResource;
+	size_t depthResource;
+	size_t msaaColorResource;								// multisampled colour, resolved into the swapchain image. MSAA only
+	std::array<size_t, GBUFFER_FORMATS.size()> gbufferResources;		// deferred path only
 
 	VkCommandPool graphicsCommandPool;
-
-	VkPipeline graphicsPipeline;
+	VkCommandPool computeCommandPool;
+	std::vector<VkCommandBuffer> computeCommandBuffers;		// 1 for each frame in flight
+
+	std::vector<ComputePipeline> computePipelines;
+	std::vector<ComputeDispatch> computeDispatches;
+
+	PipelineCache* pipelineCache = nullptr;
+	PipelineRegistry* pipelineRegistry = nullptr;			// owns every graphics pipeline
+	ShaderCompiler* shaderCompiler = nullptr;
+	ThreadPool* threadPool = nullptr;
+	StagingBuffer* stagingBuffer = nullptr;					// textures are decoded straight into it
+	bool pipelineFeedbackEnabled = false;					// VK_EXT_pipeline_creation_feedback
+
+	// Shader hot reload
+	ShaderWatcher* shaderWatcher = nullptr;
+	std::future<ShaderReload> shaderReload;					// at most one rebuild in flight
+	std::vector<RetiredPipeline> retiredPipelines;
+	std::vector<PipelineFeatures> staleVariants;			// created with the old shaders while a reload ran, owned by the renderer until rebuilt
+	bool rebuildStaleVariants = false;						// a follow-up rebuild of staleVariants is due
+	VkShaderModule vertexShaderModule;
+	VkShaderModule fragShaderModule;
+	std::unordered_map<PipelineFeatures, VkPipeline> graphicsPipelines;		// variants by feature mask, created on first use (owned by the registry)
 	VkPipelineLayout pipelineLayout;
+
+	// Deferred lighting subpass, pipeline owned by the registry and layouts by the layout cache
+	VkShaderModule lightingVertexModule = VK_NULL_HANDLE;
+	VkShaderModule lightingFragModule = VK_NULL_HANDLE;
+	VkPipeline lightingPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout lightingPipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout lightingSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool lightingDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> lightingDescriptorSets;	// 1 for each swap chain image
 	VkRenderPass renderPass;
 
 
@@ -75,41 +150,79 @@ private:
 	std::vector<VkSemaphore> imageSemaphores;
 	std::vector <VkSemaphore> renderSemaphores;
 	std::vector <VkFence> drawFences;
-
+	std::vector <VkSemaphore> computeSemaphores;				// compute -> graphics handoff, 1 for each frame in flight
+
+	// Timestamp queries, 2 per frame in flight (start and end of the command buffer)
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	float timestampPeriod = 0.0f;							// nanoseconds per timestamp tick
+	uint64_t timestampMask = ~0ull;							// timestampValidBits of the graphics queue, higher bits are undefined
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;		// validated sample count of colour and depth
+	std::vector<bool> timestampsWritten;
+	FrameTimings frameTimings;
+
+	// Layouts reflected from the graphics shaders, handles owned by the layout cache
+	DescriptorLayoutCache* layoutCache = nullptr;
+	ShaderLayout graphicsLayout;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSetLayout samplerSetLayout;
 	VkPushConstantRange pushConstantRange;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	uint32_t vertexStride = 0;
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
 	std::vector<VkDescriptorSet> descriptorSets;			// 1 for each swap chain images
-	std::vector<VkDescriptorSet> samplerDescriptorSets;		// 1 for each texture
+	std::vector<VkDescriptorSet> samplerDescriptorSets;		// 1 for each texture image, shared by its layers
 
 	std::vector<VkBuffer> vpUniformBuffer;
 	std::vector<VkDeviceMemory> vpUniformBufferMemory;
+	std::vector<VkBuffer> lightUniformBuffer;				// deferred path only
+	std::vector<VkDeviceMemory> lightUniformBufferMemory;
 
-	VkSampler textureSampler;
+	SamplerCache* samplerCache = nullptr;					// owns every texture sampler
 	std::vector<VkImage> textureImages;
 	std::vector<VkImageView> textureImageViews;
 	std::vector<VkDeviceMemory> textureImageMemory;
+	std::vector<uint32_t> textureMipLevels;
+	std::vector<VkFormat> textureFormats;
+	std::vector<uint32_t> textureLayerCounts;
+	std::vector<TextureLayer> textures;						// texture ids used by meshes
 
 #pragma region -- Create Functions --
 	void createInstance();
 	void createDebugCallback();
 	void createLogicalDevice();
+	void createPipelineCache();
+	void createPipelineRegistry();
+	void createShaderCompiler();
+	void createThreadPool();
+	void createStagingBuffer();
+	void createShaderWatcher();
 	void createSurface();
 	void createSwapChain();
 	void createRenderPass();
 	void createDescriptorSetLayout();
 	void createPushConstantRange();
 	void createGraphicsPipeline();
-	void createDepthBufferImage();
+	std::vector<PipelineBuildResult> createGraphicsPipelineVariants(const std::vector<PipelineFeatures>& variants,
+		VkShaderModule vertexModule, VkShaderModule fragModule, VkPipelineCache cache);
+	std::vector<uint32_t> loadSpirv(const std::string& fileName);
+	// Reflected inputs in the float layout of Vertex, replaced by the formats and offsets of settings.vertexLayout
+	std::vector<VkVertexInputAttributeDescription> createVertexInput(const ShaderReflection& reflection, uint32_t* stride);
+	VkPipeline buildComputePipeline(const std::string& fileName, VkPipelineLayout layout, VkPipelineCache cache);
+	void buildGraphicsPipelines(const std::vector<PipelineFeatures>& variants);
+	void createLightingPipeline();
+	VkPipeline getGraphicsPipeline(PipelineFeatures features);
+	void createRenderGraph();
 	void createFrameBuffers();
 	void createCommandPool();
 	void createCommandBuffers();
 	void createSynchronization();
+	void createTimestampQueryPool();
 	void createMesh();
-	void createTextureSampler();
+	// Packs the streams in place into settings.vertexLayout and 16 bit indices where possible, then uploads them
+	Mesh* createPackedMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t texId);
+	void createSamplerCache();
 	
 	
 	
@@ -123,6 +236,19 @@ private:
 
 	// - Record
 	void recordCommands(uint32_t imageIndex);
+	void recordForwardPass(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+	void recordDeferredPass(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+	void recordMeshes(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+	void recordComputeCommands();
+	void recordComputeAcquireBarriers(VkCommandBuffer cmdBuffer);
+	void readTimestamps();
+
+	// - Hot reload
+	void updateShaderReload();
+	ShaderReload rebuildShaders(const std::vector<std::string>& changedFiles, const std::vector<PipelineFeatures>& variants,
+		const std::vector<ComputePipeline>& computeSources);
+	void applyShaderReload(const ShaderReload& reload);
+	void retirePipeline(VkPipeline pipeline);
 
 	// - Get Functions
 	void getPhysicalDevice();
@@ -148,23 +274,54 @@ private:
 	VkPresentModeKHR chooseBestPresentationMode(const std::vector<VkPresentModeKHR>& presentationModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
 	VkFormat chooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags features);
+	VkSampleCountFlagBits chooseSampleCount(VkSampleCountFlagBits requested, VkSampleCountFlags supported);
 
 
-	VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory);
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory,
+		uint32_t mipLevels = 1, uint32_t arrayLayers = 1);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1,
+		VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t layerCount = 1, VkComponentMapping components = {});
 
 	VkShaderModule createShaderModule(const std::string& fileName);
 
 
 
-	size_t createTextureImage(std::string fileName);
-	size_t createTexture(std::string fileName);
-	size_t createTextureDescriptor(VkImageView textureImage);
-
-	void createModel(std::string modelFile);
+	size_t createTextureImage(std::string fileName, bool srgb = false);
+	// One array layer per texture, all of the same extent
+	size_t createDecodedTextureImage(const std::vector<DecodedTexture>& layers);
+	size_t createKtxTextureImage(const std::string& fileName);
+	size_t createBlobTextureImage(const std::string& fileName);
+	// Streams the levels in tiles of whole block rows through a STREAMING_WINDOW_SIZE window, levelData is usually memory-mapped
+	size_t uploadTextureImage(const std::string& fileName, VkFormat format, uint32_t width, uint32_t height,
+		const std::vector<TextureLevel>& levels, const void* levelData, VkDeviceSize dataSize);
+	// srgb: colour data stored sRGB encoded, decoded to linear when sampled. Pre-compressed textures keep their baked format
+	size_t createTexture(std::string fileName, const SamplerState& sampler = SamplerState(), bool srgb = false);
+	// Decodes on the thread pool and uploads each image as soon as it is decoded, returns texture ids in the order of fileNames
+	// Textures up to TEXTURE_ARRAY_MAX_EXTENT are held back and packed into array images by extent once all are decoded
+	// Names starting with '*' are embedded textures of scene, which has to outlive the call
+	std::vector<size_t> createTextures(const std::vector<std::string>& fileNames, const SamplerState& sampler = SamplerState(), bool srgb = false,
+		const aiScene* scene = nullptr);
+	// View and descriptor set of the image, returns one texture id per layer
+	std::vector<size_t> createTextureFromImage(size_t textureImageLoc, const SamplerState& sampler);
+	size_t createTextureDescriptor(VkImageView textureImage, VkSampler sampler);
+
+	// fileName with its directory: Models/ for baked blobs, MESH_CACHE_DIRECTORY for imported ones
+	std::vector<Mesh*> loadMeshBlob(const std::string& fileName);
+	// Converts the meshes on the thread pool straight into staging while the textures decode, then uploads all meshes with one submit
+	// Writes the streams to cachePath as a mesh blob when it is not empty
+	std::vector<Mesh*> importModel(const std::string& fileName, const std::string& cachePath, uint64_t sourceHash);
+	// Source file contents and the reflected vertex layout, a cache written with another layout is stale as well
+	uint64_t hashModelSource(const std::string& fileName);
+	bool isMeshCacheCurrent(const std::string& cachePath, uint64_t sourceHash);
 
 
 	//--loading
-	stbi_uc* loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* size);
+	// Keeps the source channel count where the device can sample it (R8, R8G8), RGB becomes RGBA
+	// Decodes directly into the staging buffer when it has room. Safe to call from worker threads
+	DecodedTexture decodeTextureFile(const std::string& fileName, bool srgb);
+	// Compressed textures (mHeight 0) are decoded like files, raw BGRA texels are converted to RGBA
+	DecodedTexture decodeEmbeddedTexture(const aiScene* scene, const std::string& name, bool srgb);
+	VkFormat chooseTextureFormat(int channels, bool srgb, int* components);
+	void releaseDecodedTexture(const DecodedTexture& texture);
 };
 
@@ -1,4 +1,8 @@
 #define STB_IMAGE_IMPLEMENTATION
+// decoded textures are allocated in staging memory, see StagingBuffer.h
+#define STBI_MALLOC(size) decodeMalloc(size)
+#define STBI_REALLOC_SIZED(data, oldSize, newSize) decodeRealloc(data, oldSize, newSize)
+#define STBI_FREE(data) decodeFree(data)
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -6,19 +10,88 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
 
+#include "StagingBuffer.h"
 #include "VkRenderer.h"
 #include "Window.h"
+#include "Benchmark.h"
 
-int main()
+// Advance the scene by deltaTime seconds
+static void updateScene(VkRenderer& vulkanRenderer, float& angle, float deltaTime)
 {
+	angle += 10.0f * deltaTime;
+
+	if (angle > 360.0f)
+	{
+		angle -= 360.0f;
+	}
+
+	glm::mat4 firstModel(1.0f);
+	glm::mat4 secondModel(1.0f);
+
+	firstModel = glm::translate(firstModel, glm::vec3(0.0f, 0.0f, -3.5f));
+	firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	secondModel = glm::translate(secondModel, glm::vec3(0.0f, 0.0f, -3.0f));
+	secondModel = glm::rotate(secondModel, glm::radians(-angle * 100), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	vulkanRenderer.updateModel(0, firstModel);
+	vulkanRenderer.updateModel(1, secondModel);
+}
+
+int main(int argc, char* argv[])
+{
+	// --deferred renders through the G-buffer and lighting subpasses instead of the forward pass
+	// --msaa 4 renders the forward pass with 4 samples per pixel (or the closest lower count the device supports)
+	// --layout packed|half|float picks the vertex buffer layout, baked mesh blobs have to be baked with the same one
+	RendererSettings rendererSettings;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--deferred")
+		{
+			rendererSettings.deferred = true;
+		}
+		else if (arg == "--msaa" && i + 1 < argc)
+		{
+			std::string samples = argv[++i];
+			try
+			{
+				rendererSettings.msaaSamples = static_cast<VkSampleCountFlagBits>(std::stoul(samples));
+			}
+			catch (const std::exception&)
+			{
+				printf("invalid sample count %s, rendering without MSAA\n", samples.c_str());
+				rendererSettings.msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+			}
+		}
+		else if (arg == "--layout" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "half") rendererSettings.vertexLayout = VertexLayout::HalfPosition;
+			else if (name == "float") rendererSettings.vertexLayout = VertexLayout::Float;
+			else if (name != "packed") printf("unknown vertex layout %s, using packed\n", name.c_str());
+		}
+	}
+
 	Window mainWindow = Window("Main Window");
-	VkRenderer vulkanRenderer = VkRenderer(mainWindow);
+	VkRenderer vulkanRenderer = VkRenderer(mainWindow, rendererSettings);
 
 	float angle = 0.0f;
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
 
+	// Fixed time step run for repeatable measurements, e.g. VulkanCourseApp --benchmark --warmup 120 --frames 1000 --out bench.json
+	BenchmarkSettings benchmarkSettings;
+	if (Benchmark::parseArguments(argc, argv, &benchmarkSettings))
+	{
+		Benchmark benchmark(mainWindow, vulkanRenderer, benchmarkSettings);
+		benchmark.run([&](float fixedDeltaTime) { updateScene(vulkanRenderer, angle, fixedDeltaTime); });
+		benchmark.writeReport();
+		return EXIT_SUCCESS;
+	}
+
 	while (mainWindow.IsRunning())
 	{
 		glfwPollEvents();
@@ -27,24 +100,7 @@ int main()
 		deltaTime = now - lastTime;
 		lastTime = now;
 
-		angle += 10.0f * deltaTime;
-
-		if (angle > 360.0f)
-		{
-			angle -= 360.0f;
-		}
-
-		glm::mat4 firstModel(1.0f);
-		glm::mat4 secondModel(1.0f);
-
-		firstModel = glm::translate(firstModel, glm::vec3(0.0f, 0.0f, -3.5f));
-		firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		secondModel = glm::translate(secondModel, glm::vec3(0.0f, 0.0f, -3.0f));
-		secondModel = glm::rotate(secondModel, glm::radians(-angle * 100), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		vulkanRenderer.updateModel(0, firstModel);
-		vulkanRenderer.updateModel(1, secondModel);
+		updateScene(vulkanRenderer, angle, deltaTime);
 
 		vulkanRenderer.draw();
 	}